@@ -0,0 +1,72 @@
+/*
+ * CaptureScheduler.cpp
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+#include "CaptureScheduler.h"
+#include "Log.h"
+#include "Sink.h"
+
+CaptureScheduler::CaptureScheduler(int minDelay, int maxDelay, double cpuBudget, const MeterLayout & layout) :
+    _layout(layout), _minDelay(minDelay), _maxDelay(maxDelay), _cpuBudget(cpuBudget), _delay(minDelay),
+    _lastValue(-1.), _rate(0.), _rejects(0.) {
+}
+
+/**
+ * Value of the last digit read, readings may lack the last decimals.
+ */
+double CaptureScheduler::resolution(const std::string & ocr) const {
+    int integers = _layout.digits() - _layout.decimals();
+    int length = ocr.length();
+    if (length < integers || length > _layout.digits()) {
+        return 1. / _layout.scale();
+    }
+    return pow(10., integers - length);
+}
+
+void CaptureScheduler::update(const Reading & reading, double busy) {
+    if (_maxDelay <= _minDelay) {
+        return;
+    }
+    bool changed = reading.ocr != _lastOcr;
+    _lastOcr = reading.ocr;
+    _rejects = 0.8 * _rejects + (reading.checked ? 0. : 0.2);
+    if (reading.checked) {
+        double dt = reading.checkedTime - _lastTime;
+        if (_lastTime.isSet() && dt > 0.) {
+            double rate = std::max(0., (reading.value - _lastValue) / dt);
+            _rate = (_rate + rate) / 2.;
+        }
+        _lastValue = reading.value;
+        _lastTime = reading.checkedTime;
+    }
+
+    // counter moves: fastest rate, else slow down step by step
+    double delay = changed ? _minDelay : _delay * 1.5;
+    if (_rate > 0.) {
+        // see each step of the last digit at least twice
+        delay = std::min(delay, 500. * resolution(reading.ocr) / _rate);
+    }
+    if (_rejects > 0.5) {
+        // Plausi needs a full window of readings
+        delay = std::min(delay, 4. * _minDelay);
+    }
+    delay = std::max((double) _minDelay, std::min((double) _maxDelay, delay));
+    if (_cpuBudget > 0. && _cpuBudget < 1.) {
+        delay = std::max(delay, 1000. * busy * (1. - _cpuBudget) / _cpuBudget);
+    }
+    if ((int) delay != _delay) {
+        LOG_DEBUG("Capture delay %d ms, consumption %.5f/s, rejects %.2f", (int) delay, _rate, _rejects);
+    }
+    _delay = (int) delay;
+}
+
+void CaptureScheduler::sleep(const volatile bool & stop) const {
+    for (int left = _delay; left > 0 && !stop; left -= 200) {
+        usleep(std::min(left, 200) * 1000L);
+    }
+}
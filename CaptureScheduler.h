@@ -0,0 +1,58 @@
+/*
+ * CaptureScheduler.h
+ *
+ * Delay between two images that follows the meter: the fixed delay (-s)
+ * is the shortest one, used while the counter moves. While the image and
+ * the value stay the same the delay grows up to maxDelay. The delay is
+ * also limited to half the time the last digit needs at the current
+ * consumption, and to the CPU budget given as share of one core.
+ *
+ */
+
+#ifndef CAPTURESCHEDULER_H_
+#define CAPTURESCHEDULER_H_
+
+#include <string>
+
+#include "MeterProfile.h"
+#include "Timestamp.h"
+
+struct Reading;
+
+class CaptureScheduler {
+public:
+    // maxDelay <= minDelay: fixed delay
+    CaptureScheduler(int minDelay, int maxDelay, double cpuBudget, const MeterLayout & layout = MeterLayout());
+
+    // busy: seconds spent on the reading
+    void update(const Reading & reading, double busy);
+
+    // milliseconds
+    int delay() const {
+        return _delay;
+    }
+
+    // consumption per second, 0 if unknown
+    double rate() const {
+        return _rate;
+    }
+
+    // wait delay() ms, return early when stop is set
+    void sleep(const volatile bool & stop) const;
+
+private:
+    double resolution(const std::string & ocr) const;
+
+    MeterLayout _layout;
+    int _minDelay;
+    int _maxDelay;
+    double _cpuBudget;
+    int _delay;
+    std::string _lastOcr;
+    double _lastValue;
+    Timestamp _lastTime;
+    double _rate;
+    double _rejects;
+};
+
+#endif /* CAPTURESCHEDULER_H_ */
@@ -15,7 +15,67 @@ Config::Config() :
     _digitYAlignment(10),
     _cannyThreshold1(100),
     _cannyThreshold2(200),
-    _trainingDataFilename("trainctr.yml") {
+    _trainingDataFilename("trainctr.yml"),
+    _imageFormat("png"),
+    _imageQuality(3),
+    _archiveQueueSize(16),
+    _snapshotMaxFiles(1000),
+    _snapshotMinFreeMB(100),
+    _snapshotDir(""),
+    _inotifyStateFile("inotify.state"),
+    _plausiMaxPower(5.),
+    _plausiWindow(3),
+    _plausiMedian(0),
+    _plausiReconcile(0),
+    _plausiStateFile("plausi.state"),
+    _plausiStateMaxAge(3600),
+    _rrdFlushInterval(300),
+    _rrdFlushCount(30),
+    _rrdBulkCount(1000),
+    _rrdDaemon(""),
+    _seriesDir(""),
+    _sinks(""),
+    _sinkFile("readings.jsonl"),
+    _sinkQueueSize(64),
+    _mqttDeadband(0.001),
+    _mqttMinInterval(10),
+    _mqttHeartbeat(300),
+    _mqttBatch(1),
+    _mqttHost("192.168.0.106"),
+    _mqttPort(8883),
+    _mqttSpoolFile("mqtt.spool"),
+    _mqttSpoolMax(100000),
+    _mqttReplayRate(5),
+    _rrdFile("emeter.rrd"),
+    _meterThreads(0),
+    _metricsPort(0),
+    _metricsAddress("127.0.0.1"),
+    _metricsInterval(60),
+    _traceFile(""),
+    _traceEvents(65536),
+    _scheduleMaxDelay(0),
+    _scheduleCpuBudget(0.25),
+    _qualityGate("flag"),
+    _qualityMinMean(20),
+    _qualityMaxMean(235),
+    _qualityMaxSaturated(0.25),
+    _qualityMinSharpness(10),
+    _qualityMinEdges(0.005),
+    _qualityMaxEdges(0.3),
+    _segmentation("contours"),
+    _meterDigits(8),
+    _meterDecimals(3) {
+}
+
+/**
+ * Read value only if present, keep the default for config files of older versions.
+ */
+template<typename T>
+static void readOptional(const cv::FileStorage & fs, const char * name, T & value) {
+    cv::FileNode node = fs[name];
+    if (!node.empty()) {
+        node >> value;
+    }
 }
 
 void Config::saveConfig(const std::string & configPath) {
@@ -34,9 +94,76 @@ void Config::saveConfig() {
     fs << "digitYAlignment" << _digitYAlignment;
     fs << "ocrMaxDist" << _ocrMaxDist;
     fs << "trainingDataFilename" << _trainingDataFilename;
+    fs << "imageFormat" << _imageFormat;
+    fs << "imageQuality" << _imageQuality;
+    fs << "archiveQueueSize" << _archiveQueueSize;
+    fs << "snapshotMaxFiles" << _snapshotMaxFiles;
+    fs << "snapshotMinFreeMB" << _snapshotMinFreeMB;
+    fs << "snapshotDir" << _snapshotDir;
+    fs << "inotifyStateFile" << _inotifyStateFile;
+    fs << "plausiMaxPower" << _plausiMaxPower;
+    fs << "plausiWindow" << _plausiWindow;
+    fs << "plausiMedian" << _plausiMedian;
+    fs << "plausiReconcile" << _plausiReconcile;
+    fs << "plausiStateFile" << _plausiStateFile;
+    fs << "plausiStateMaxAge" << _plausiStateMaxAge;
+    fs << "rrdFlushInterval" << _rrdFlushInterval;
+    fs << "rrdFlushCount" << _rrdFlushCount;
+    fs << "rrdBulkCount" << _rrdBulkCount;
+    fs << "rrdDaemon" << _rrdDaemon;
+    fs << "seriesDir" << _seriesDir;
+    fs << "sinks" << _sinks;
+    fs << "sinkFile" << _sinkFile;
+    fs << "sinkQueueSize" << _sinkQueueSize;
+    fs << "mqttDeadband" << _mqttDeadband;
+    fs << "mqttMinInterval" << _mqttMinInterval;
+    fs << "mqttHeartbeat" << _mqttHeartbeat;
+    fs << "mqttBatch" << _mqttBatch;
+    fs << "mqttHost" << _mqttHost;
+    fs << "mqttPort" << _mqttPort;
+    fs << "mqttSpoolFile" << _mqttSpoolFile;
+    fs << "mqttSpoolMax" << _mqttSpoolMax;
+    fs << "mqttReplayRate" << _mqttReplayRate;
+    fs << "rrdFile" << _rrdFile;
+    fs << "meterThreads" << _meterThreads;
+    fs << "metricsPort" << _metricsPort;
+    fs << "metricsAddress" << _metricsAddress;
+    fs << "metricsInterval" << _metricsInterval;
+    fs << "traceFile" << _traceFile;
+    fs << "traceEvents" << _traceEvents;
+    fs << "scheduleMaxDelay" << _scheduleMaxDelay;
+    fs << "scheduleCpuBudget" << _scheduleCpuBudget;
+    fs << "qualityGate" << _qualityGate;
+    fs << "qualityMinMean" << _qualityMinMean;
+    fs << "qualityMaxMean" << _qualityMaxMean;
+    fs << "qualityMaxSaturated" << _qualityMaxSaturated;
+    fs << "qualityMinSharpness" << _qualityMinSharpness;
+    fs << "qualityMinEdges" << _qualityMinEdges;
+    fs << "qualityMaxEdges" << _qualityMaxEdges;
+    fs << "segmentation" << _segmentation;
+    fs << "meterDigits" << _meterDigits;
+    fs << "meterDecimals" << _meterDecimals;
     fs.release();
 }
 
+static void prefixDefault(std::string & file, const std::string & defaultFile, const std::string & name) {
+    if (file == defaultFile) {
+        file = name + "." + defaultFile;
+    }
+}
+
+/**
+ * Files of one of several meters (-M): a state, spool or rrd file with its default name
+ * gets the meter name as prefix, e.g. gas.plausi.state, so the meters don't share them.
+ */
+void Config::setMeterName(const std::string & name) {
+    const Config defaults;
+    prefixDefault(_inotifyStateFile, defaults._inotifyStateFile, name);
+    prefixDefault(_plausiStateFile, defaults._plausiStateFile, name);
+    prefixDefault(_mqttSpoolFile, defaults._mqttSpoolFile, name);
+    prefixDefault(_rrdFile, defaults._rrdFile, name);
+}
+
 void Config::loadConfig(const std::string & configPath) {
     _configPath = configPath;
     loadConfig();
@@ -46,17 +173,89 @@ void Config::loadConfig() {
     std::cout << "Load config from " << _configPath << "\n";
     cv::FileStorage fs(_configPath, cv::FileStorage::READ);
     if (fs.isOpened()) {
-        fs["rotationDegrees"] >> _rotationDegrees;
-        fs["cannyThreshold1"] >> _cannyThreshold1;
-        fs["cannyThreshold2"] >> _cannyThreshold2;
-        fs["digitMinHeight"] >> _digitMinHeight;
-        fs["digitMaxHeight"] >> _digitMaxHeight;
-        fs["digitYAlignment"] >> _digitYAlignment;
-        fs["ocrMaxDist"] >> _ocrMaxDist;
-        fs["trainingDataFilename"] >> _trainingDataFilename;
+        read(fs);
         fs.release();
     } else {
         // no config file - create an initial one with default values
         saveConfig();
     }
 }
+
+/**
+ * Read the config file again. Unlike loadConfig() a missing file is not
+ * replaced by defaults, an editor may just be replacing it.
+ */
+bool Config::reloadConfig(const std::string & configPath) {
+    _configPath = configPath;
+    cv::FileStorage fs(_configPath, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        return false;
+    }
+    read(fs);
+    fs.release();
+    return true;
+}
+
+void Config::read(const cv::FileStorage & fs) {
+    fs["rotationDegrees"] >> _rotationDegrees;
+    fs["cannyThreshold1"] >> _cannyThreshold1;
+    fs["cannyThreshold2"] >> _cannyThreshold2;
+    fs["digitMinHeight"] >> _digitMinHeight;
+    fs["digitMaxHeight"] >> _digitMaxHeight;
+    fs["digitYAlignment"] >> _digitYAlignment;
+    fs["ocrMaxDist"] >> _ocrMaxDist;
+    fs["trainingDataFilename"] >> _trainingDataFilename;
+    readOptional(fs, "imageFormat", _imageFormat);
+    readOptional(fs, "imageQuality", _imageQuality);
+    readOptional(fs, "archiveQueueSize", _archiveQueueSize);
+    readOptional(fs, "snapshotMaxFiles", _snapshotMaxFiles);
+    readOptional(fs, "snapshotMinFreeMB", _snapshotMinFreeMB);
+    readOptional(fs, "snapshotDir", _snapshotDir);
+    readOptional(fs, "inotifyStateFile", _inotifyStateFile);
+    readOptional(fs, "plausiMaxPower", _plausiMaxPower);
+    readOptional(fs, "plausiWindow", _plausiWindow);
+    if (_plausiWindow < 1) {
+        // Plausi needs at least the current value in the window
+        _plausiWindow = 1;
+    }
+    readOptional(fs, "plausiMedian", _plausiMedian);
+    readOptional(fs, "plausiReconcile", _plausiReconcile);
+    readOptional(fs, "plausiStateFile", _plausiStateFile);
+    readOptional(fs, "plausiStateMaxAge", _plausiStateMaxAge);
+    readOptional(fs, "rrdFlushInterval", _rrdFlushInterval);
+    readOptional(fs, "rrdFlushCount", _rrdFlushCount);
+    readOptional(fs, "rrdBulkCount", _rrdBulkCount);
+    readOptional(fs, "rrdDaemon", _rrdDaemon);
+    readOptional(fs, "seriesDir", _seriesDir);
+    readOptional(fs, "sinks", _sinks);
+    readOptional(fs, "sinkFile", _sinkFile);
+    readOptional(fs, "sinkQueueSize", _sinkQueueSize);
+    readOptional(fs, "mqttDeadband", _mqttDeadband);
+    readOptional(fs, "mqttMinInterval", _mqttMinInterval);
+    readOptional(fs, "mqttHeartbeat", _mqttHeartbeat);
+    readOptional(fs, "mqttBatch", _mqttBatch);
+    readOptional(fs, "mqttHost", _mqttHost);
+    readOptional(fs, "mqttPort", _mqttPort);
+    readOptional(fs, "mqttSpoolFile", _mqttSpoolFile);
+    readOptional(fs, "mqttSpoolMax", _mqttSpoolMax);
+    readOptional(fs, "mqttReplayRate", _mqttReplayRate);
+    readOptional(fs, "rrdFile", _rrdFile);
+    readOptional(fs, "meterThreads", _meterThreads);
+    readOptional(fs, "metricsPort", _metricsPort);
+    readOptional(fs, "metricsAddress", _metricsAddress);
+    readOptional(fs, "metricsInterval", _metricsInterval);
+    readOptional(fs, "traceFile", _traceFile);
+    readOptional(fs, "traceEvents", _traceEvents);
+    readOptional(fs, "scheduleMaxDelay", _scheduleMaxDelay);
+    readOptional(fs, "scheduleCpuBudget", _scheduleCpuBudget);
+    readOptional(fs, "qualityGate", _qualityGate);
+    readOptional(fs, "qualityMinMean", _qualityMinMean);
+    readOptional(fs, "qualityMaxMean", _qualityMaxMean);
+    readOptional(fs, "qualityMaxSaturated", _qualityMaxSaturated);
+    readOptional(fs, "qualityMinSharpness", _qualityMinSharpness);
+    readOptional(fs, "qualityMinEdges", _qualityMinEdges);
+    readOptional(fs, "qualityMaxEdges", _qualityMaxEdges);
+    readOptional(fs, "segmentation", _segmentation);
+    readOptional(fs, "meterDigits", _meterDigits);
+    readOptional(fs, "meterDecimals", _meterDecimals);
+}
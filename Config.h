@@ -8,6 +8,10 @@
 
 #include <string>
 
+namespace cv {
+class FileStorage;
+}
+
 class Config {
 public:
     Config();
@@ -15,6 +19,8 @@ public:
     void saveConfig(const std::string & configPath);
     void loadConfig();
     void loadConfig(const std::string & configPath);
+    void setMeterName(const std::string & name);
+    bool reloadConfig(const std::string & configPath);
 
     int getDigitMaxHeight() const {
         return _digitMaxHeight;
@@ -48,7 +54,229 @@ public:
         return _cannyThreshold2;
     }
 
+    std::string getImageFormat() const {
+        return _imageFormat;
+    }
+
+    int getImageQuality() const {
+        return _imageQuality;
+    }
+
+    int getArchiveQueueSize() const {
+        return _archiveQueueSize;
+    }
+
+    int getSnapshotMaxFiles() const {
+        return _snapshotMaxFiles;
+    }
+
+    int getSnapshotMinFreeMB() const {
+        return _snapshotMinFreeMB;
+    }
+
+    std::string getSnapshotDir() const {
+        return _snapshotDir;
+    }
+
+    std::string getInotifyStateFile() const {
+        return _inotifyStateFile;
+    }
+
+    double getPlausiMaxPower() const {
+        return _plausiMaxPower;
+    }
+
+    int getPlausiWindow() const {
+        return _plausiWindow;
+    }
+
+    bool getPlausiMedian() const {
+        return _plausiMedian != 0;
+    }
+
+    bool getPlausiReconcile() const {
+        return _plausiReconcile != 0;
+    }
+
+    std::string getPlausiStateFile() const {
+        return _plausiStateFile;
+    }
+
+    int getPlausiStateMaxAge() const {
+        return _plausiStateMaxAge;
+    }
+
+    int getRrdFlushInterval() const {
+        return _rrdFlushInterval;
+    }
+
+    int getRrdFlushCount() const {
+        return _rrdFlushCount;
+    }
+
+    int getRrdBulkCount() const {
+        return _rrdBulkCount;
+    }
+
+    std::string getRrdDaemon() const {
+        return _rrdDaemon;
+    }
+
+    std::string getSeriesDir() const {
+        return _seriesDir;
+    }
+
+    std::string getSinks() const {
+        return _sinks;
+    }
+
+    std::string getSinkFile() const {
+        return _sinkFile;
+    }
+
+    int getSinkQueueSize() const {
+        return _sinkQueueSize;
+    }
+
+    double getMqttDeadband() const {
+        return _mqttDeadband;
+    }
+
+    int getMqttMinInterval() const {
+        return _mqttMinInterval;
+    }
+
+    int getMqttHeartbeat() const {
+        return _mqttHeartbeat;
+    }
+
+    int getMqttBatch() const {
+        return _mqttBatch;
+    }
+
+    std::string getMqttHost() const {
+        return _mqttHost;
+    }
+
+    int getMqttPort() const {
+        return _mqttPort;
+    }
+
+    std::string getMqttSpoolFile() const {
+        return _mqttSpoolFile;
+    }
+
+    int getMqttSpoolMax() const {
+        return _mqttSpoolMax;
+    }
+
+    int getMqttReplayRate() const {
+        return _mqttReplayRate;
+    }
+
+    std::string getRrdFile() const {
+        return _rrdFile;
+    }
+
+    int getMeterThreads() const {
+        return _meterThreads;
+    }
+
+    int getMetricsPort() const {
+        return _metricsPort;
+    }
+
+    std::string getMetricsAddress() const {
+        return _metricsAddress;
+    }
+
+    int getMetricsInterval() const {
+        return _metricsInterval;
+    }
+
+    std::string getTraceFile() const {
+        return _traceFile;
+    }
+
+    int getTraceEvents() const {
+        return _traceEvents;
+    }
+
+    int getScheduleMaxDelay() const {
+        return _scheduleMaxDelay;
+    }
+
+    double getScheduleCpuBudget() const {
+        return _scheduleCpuBudget;
+    }
+
+    std::string getQualityGate() const {
+        return _qualityGate;
+    }
+
+    double getQualityMinMean() const {
+        return _qualityMinMean;
+    }
+
+    double getQualityMaxMean() const {
+        return _qualityMaxMean;
+    }
+
+    double getQualityMaxSaturated() const {
+        return _qualityMaxSaturated;
+    }
+
+    double getQualityMinSharpness() const {
+        return _qualityMinSharpness;
+    }
+
+    double getQualityMinEdges() const {
+        return _qualityMinEdges;
+    }
+
+    double getQualityMaxEdges() const {
+        return _qualityMaxEdges;
+    }
+
+    // parameters searched by autotune
+    void setCannyThresholds(int threshold1, int threshold2) {
+        _cannyThreshold1 = threshold1;
+        _cannyThreshold2 = threshold2;
+    }
+
+    void setDigitHeights(int minHeight, int maxHeight) {
+        _digitMinHeight = minHeight;
+        _digitMaxHeight = maxHeight;
+    }
+
+    void setDigitYAlignment(int yAlignment) {
+        _digitYAlignment = yAlignment;
+    }
+
+    void setOcrMaxDist(float maxDist) {
+        _ocrMaxDist = maxDist;
+    }
+
+    // training file of the loaded model, see KNearestOcr::setConfig
+    void setTrainingDataFilename(const std::string & filename) {
+        _trainingDataFilename = filename;
+    }
+
+    std::string getSegmentation() const {
+        return _segmentation;
+    }
+
+    int getMeterDigits() const {
+        return _meterDigits;
+    }
+
+    int getMeterDecimals() const {
+        return _meterDecimals;
+    }
+
 private:
+    void read(const cv::FileStorage & fs);
+
     int _rotationDegrees;
     float _ocrMaxDist;
     int _digitMinHeight;
@@ -57,6 +285,55 @@ private:
     int _cannyThreshold1;
     int _cannyThreshold2;
     std::string _trainingDataFilename;
+    std::string _imageFormat;
+    int _imageQuality;
+    int _archiveQueueSize;
+    int _snapshotMaxFiles;
+    int _snapshotMinFreeMB;
+    std::string _snapshotDir;
+    std::string _inotifyStateFile;
+    double _plausiMaxPower;
+    int _plausiWindow;
+    int _plausiMedian;
+    int _plausiReconcile;
+    std::string _plausiStateFile;
+    int _plausiStateMaxAge;
+    int _rrdFlushInterval;
+    int _rrdFlushCount;
+    int _rrdBulkCount;
+    std::string _rrdDaemon;
+    std::string _seriesDir;
+    std::string _sinks;
+    std::string _sinkFile;
+    int _sinkQueueSize;
+    double _mqttDeadband;
+    int _mqttMinInterval;
+    int _mqttHeartbeat;
+    int _mqttBatch;
+    std::string _mqttHost;
+    int _mqttPort;
+    std::string _mqttSpoolFile;
+    int _mqttSpoolMax;
+    int _mqttReplayRate;
+    std::string _rrdFile;
+    int _meterThreads;
+    int _metricsPort;
+    std::string _metricsAddress;
+    int _metricsInterval;
+    std::string _traceFile;
+    int _traceEvents;
+    int _scheduleMaxDelay;
+    double _scheduleCpuBudget;
+    std::string _qualityGate;
+    double _qualityMinMean;
+    double _qualityMaxMean;
+    double _qualityMaxSaturated;
+    double _qualityMinSharpness;
+    double _qualityMinEdges;
+    double _qualityMaxEdges;
+    std::string _segmentation;
+    int _meterDigits;
+    int _meterDecimals;
     std::string _configPath = "config.yml";
 };
 
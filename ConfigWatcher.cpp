@@ -0,0 +1,141 @@
+/*
+ * ConfigWatcher.cpp
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "ConfigWatcher.h"
+
+volatile sig_atomic_t ConfigWatcher::_reloadRequested = 0;
+
+static void splitPath(const std::string & path, std::string & dir, std::string & name) {
+    size_t slash = path.rfind('/');
+    dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    name = slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+ConfigWatcher::ConfigWatcher(const std::string & path, const Config & config) :
+    _path(path), _config(std::make_shared<const Config>(config)), _version(0), _trainingVersion(0),
+    _inotifyFd(-1), _configWatch(-1), _trainingWatch(-1), _stop(false) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+
+    // watch the directory: editors replace the file instead of writing it
+    splitPath(path, _dir, _name);
+
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd != -1) {
+        _configWatch = inotify_add_watch(_inotifyFd, _dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+    if (_configWatch == -1) {
+        rlog << log4cpp::Priority::ERROR << "Can't watch " << path << " :" << std::strerror(errno)
+             << ", reload with SIGHUP only";
+    }
+    watchTraining(config.getTrainingDataFilename());
+    _thread = std::thread(&ConfigWatcher::run, this);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    _stop = true;
+    _thread.join();
+    if (_inotifyFd != -1) {
+        close(_inotifyFd);
+    }
+}
+
+void ConfigWatcher::run() {
+    while (!_stop) {
+        if (changed() || _reloadRequested) {
+            _reloadRequested = 0;
+            reload();
+        }
+    }
+}
+
+/**
+ * Watch the directory of the training file of the current config.
+ */
+void ConfigWatcher::watchTraining(const std::string & path) {
+    if (_inotifyFd == -1 || path == _trainingPath) {
+        return;
+    }
+    // the watch of a shared directory stays for the config file
+    if (_trainingWatch != -1 && _trainingWatch != _configWatch) {
+        inotify_rm_watch(_inotifyFd, _trainingWatch);
+    }
+    std::string dir;
+    splitPath(path, dir, _trainingName);
+    _trainingPath = path;
+    _trainingWatch = inotify_add_watch(_inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (_trainingWatch == -1) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't watch " << path << " :"
+                                     << std::strerror(errno) << ", reload it with a new trainingDataFilename only";
+    }
+}
+
+/**
+ * Wait up to a second for the config file to be written.
+ * Writes to the training file are counted on the way.
+ */
+bool ConfigWatcher::changed() {
+    if (_inotifyFd == -1) {
+        sleep(1);
+        return false;
+    }
+    struct pollfd pfd = { _inotifyFd, POLLIN, 0 };
+    if (poll(&pfd, 1, 1000) <= 0) {
+        return false;
+    }
+
+    bool result = false;
+    std::vector<char> buffer(16 * (sizeof(struct inotify_event) + NAME_MAX + 1));
+    ssize_t len;
+    while ((len = read(_inotifyFd, buffer.data(), buffer.size())) > 0) {
+        for (char * p = buffer.data(); p < buffer.data() + len;) {
+            const struct inotify_event * event = (const struct inotify_event *) p;
+            if (event->len > 0 && event->wd == _configWatch && _name == event->name) {
+                result = true;
+            }
+            if (event->len > 0 && event->wd == _trainingWatch && _trainingName == event->name) {
+                ++_trainingVersion;
+                log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Training data " << _trainingPath
+                                             << " changed";
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return result;
+}
+
+/**
+ * Load a new snapshot, a file that can't be read keeps the current one.
+ */
+void ConfigWatcher::reload() {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    std::shared_ptr<Config> config = std::make_shared<Config>();
+    try {
+        if (!config->reloadConfig(_path)) {
+            rlog << log4cpp::Priority::WARN << "Can't read " << _path << ", config not reloaded";
+            return;
+        }
+    } catch (cv::Exception & e) {
+        rlog << log4cpp::Priority::ERROR << "Invalid config " << _path << ": " << e.what();
+        return;
+    }
+    std::atomic_store(&_config, std::shared_ptr<const Config>(config));
+    ++_version;
+    watchTraining(config->getTrainingDataFilename());
+    rlog << log4cpp::Priority::INFO << "Reloaded config " << _path;
+}
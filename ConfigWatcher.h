@@ -0,0 +1,70 @@
+/*
+ * ConfigWatcher.h
+ *
+ * Reloads the config file when it is changed or on SIGHUP. Each reload
+ * creates a new immutable snapshot; the processing loop polls version()
+ * at frame boundaries and hands the new snapshot to its components.
+ * Writes to the training file of the config are counted in trainingVersion().
+ *
+ */
+
+#ifndef CONFIGWATCHER_H_
+#define CONFIGWATCHER_H_
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <csignal>
+
+#include "Config.h"
+
+class ConfigWatcher {
+public:
+    ConfigWatcher(const std::string & path, const Config & config);
+    ~ConfigWatcher();
+
+    std::shared_ptr<const Config> get() const {
+        return std::atomic_load(&_config);
+    }
+
+    // incremented with every successful reload
+    unsigned version() const {
+        return _version;
+    }
+
+    // incremented whenever the training file is written, e.g. by -l
+    unsigned trainingVersion() const {
+        return _trainingVersion;
+    }
+
+    // async signal safe, for the SIGHUP handler
+    static void requestReload() {
+        _reloadRequested = 1;
+    }
+
+private:
+    void run();
+    bool changed();
+    void reload();
+    void watchTraining(const std::string & path);
+
+    std::string _path;
+    std::string _dir;
+    std::string _name;
+    std::string _trainingPath;
+    std::string _trainingName;
+    std::shared_ptr<const Config> _config;
+    std::atomic<unsigned> _version;
+    std::atomic<unsigned> _trainingVersion;
+    int _inotifyFd;
+    // watch descriptors of the directories of the config and the training file, may be the same
+    int _configWatch;
+    int _trainingWatch;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+
+    static volatile sig_atomic_t _reloadRequested;
+};
+
+#endif /* CONFIGWATCHER_H_ */
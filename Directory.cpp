@@ -5,8 +5,12 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <algorithm>
+#include <ctime>
 #include <dirent.h>
 #include <cstring>
+#include <cctype>
 
 #include "Directory.h"
 
@@ -30,6 +34,49 @@ std::list<std::string> Directory::list() {
     return files;
 }
 
+/**
+ * List files with a time in [from, to] parsed from the file name, sorted by time.
+ * The entries are filtered while reading the directory, so only the requested range is kept and sorted.
+ * to = 0 means no upper limit. Files without a valid time in their name are skipped.
+ */
+std::vector<TimedFile> Directory::listTimed(time_t from, time_t to) {
+    std::vector<TimedFile> files;
+    DIR *dir;
+    struct dirent *ent;
+    TimedFile file;
+
+    if ((dir = opendir(_path.c_str())) != NULL) {
+        while ((ent = readdir(dir)) != NULL) {
+            if ((ent->d_type == DT_REG || ent->d_type == DT_LNK)
+                    && hasExtension(ent->d_name, _extension.c_str())
+                    && parseTime(ent->d_name, file.time)
+                    && file.time.time() >= from && (to == 0 || file.time.time() <= to)) {
+                file.name = ent->d_name;
+                files.push_back(file);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::list<std::string> Directory::listDirectories() {
+    std::list<std::string> dirs;
+    DIR *dir;
+    struct dirent *ent;
+
+    if ((dir = opendir(_path.c_str())) != NULL) {
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_type == DT_DIR && strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+                dirs.push_back(std::string(ent->d_name));
+            }
+        }
+        closedir(dir);
+    }
+    return dirs;
+}
+
 std::string Directory::fullpath(const std::string filename) {
     std::string path(_path);
     path += "/";
@@ -48,3 +95,42 @@ bool Directory::hasExtension(const char* name, const char* ext) {
 std::string Directory::path() {
     return _path;
 }
+
+/**
+ * Parse local time from a file name starting with YYYYMMDD-HHMMSS
+ * and optional milliseconds YYYYMMDD-HHMMSS-mmm.
+ * mktime() is only called once per hour of file names.
+ */
+bool Directory::parseTime(const char* name, Timestamp & time) {
+    for (int i = 0; i < 15; ++i) {
+        if (i == 8 ? name[i] != '-' : (name[i] < '0' || name[i] > '9')) {
+            return false;
+        }
+    }
+    int year = (name[0] - '0') * 1000 + (name[1] - '0') * 100 + (name[2] - '0') * 10 + (name[3] - '0');
+    int mon = (name[4] - '0') * 10 + (name[5] - '0');
+    int mday = (name[6] - '0') * 10 + (name[7] - '0');
+    int hour = (name[9] - '0') * 10 + (name[10] - '0');
+    int min = (name[11] - '0') * 10 + (name[12] - '0');
+    int sec = (name[13] - '0') * 10 + (name[14] - '0');
+
+    static thread_local long cachedHour = -1;
+    static thread_local time_t cachedTime = 0;
+    long hourKey = ((year * 100L + mon) * 100L + mday) * 100L + hour;
+    if (hourKey != cachedHour) {
+        struct tm date;
+        memset(&date, 0, sizeof(date));
+        date.tm_year = year - 1900;
+        date.tm_mon = mon - 1;
+        date.tm_mday = mday;
+        date.tm_hour = hour;
+        cachedTime = mktime(&date);
+        cachedHour = hourKey;
+    }
+    int msec = 0;
+    if (name[15] == '-' && isdigit(name[16]) && isdigit(name[17]) && isdigit(name[18]) && !isdigit(name[19])) {
+        msec = (name[16] - '0') * 100 + (name[17] - '0') * 10 + (name[18] - '0');
+    }
+    time = Timestamp::fromTime(cachedTime + min * 60 + sec, msec * 1000L);
+    return true;
+}
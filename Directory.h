@@ -8,15 +8,34 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <ctime>
+
+#include "Timestamp.h"
+
+/**
+ * Image file with the time parsed from its name.
+ */
+struct TimedFile {
+    Timestamp time;
+    std::string name;
+
+    bool operator<(const TimedFile & other) const {
+        return time < other.time || (time == other.time && name < other.name);
+    }
+};
 
 class Directory {
 public:
     Directory(const char* path, const char* extension);
 
     std::list<std::string> list();
+    std::list<std::string> listDirectories();
+    std::vector<TimedFile> listTimed(time_t from = 0, time_t to = 0);
     std::string fullpath(const std::string filename);
     std::string path();
     static bool hasExtension(const char* name, const char* ext);
+    static bool parseTime(const char* name, Timestamp & time);
 private:
 
     std::string _path;
@@ -0,0 +1,288 @@
+/*
+ * FrameArchive.cpp
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "FrameArchive.h"
+
+#define ARCHIVE_MAGIC "EMEOFRA"
+#define ARCHIVE_VERSION 2 /* 1: times in seconds */
+#define RECORD_MAGIC 0x314d5246 /* "FRM1" */
+#define FOOTER_MAGIC 0x58444946 /* "FIDX" */
+
+/**
+ * Build the frame index of an archive file in memory.
+ * Uses the trailing index if present, otherwise scans the records.
+ * dataEnd is set to the end of the last complete record.
+ */
+static bool parseArchive(const unsigned char * data, size_t size,
+                         std::vector<FrameIndexEntry> & index, uint64_t & dataEnd) {
+    index.clear();
+    if (size < sizeof(FrameArchiveHeader)
+            || memcmp(data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+            || ((const FrameArchiveHeader *) data)->version != ARCHIVE_VERSION) {
+        return false;
+    }
+
+    if (size >= sizeof(FrameArchiveHeader) + sizeof(FrameArchiveFooter)) {
+        FrameArchiveFooter footer;
+        memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+        if (footer.magic == FOOTER_MAGIC
+                && footer.indexOffset >= sizeof(FrameArchiveHeader)
+                && footer.indexOffset + footer.count * sizeof(FrameIndexEntry) + sizeof(footer) == size) {
+            index.resize(footer.count);
+            memcpy(index.data(), data + footer.indexOffset, footer.count * sizeof(FrameIndexEntry));
+            dataEnd = footer.indexOffset;
+            return true;
+        }
+    }
+
+    // no valid footer: scan records
+    uint64_t offset = sizeof(FrameArchiveHeader);
+    while (offset + sizeof(FrameRecordHeader) <= size) {
+        FrameRecordHeader record;
+        memcpy(&record, data + offset, sizeof(record));
+        if (record.magic != RECORD_MAGIC || offset + sizeof(record) + record.size > size) {
+            break;
+        }
+        FrameIndexEntry entry = { record.time, offset };
+        index.push_back(entry);
+        offset += sizeof(record) + record.size;
+    }
+    dataEnd = offset;
+    return true;
+}
+
+FrameArchiveWriter::FrameArchiveWriter(const std::string & dir) :
+    _dir(dir), _fd(-1), _end(0) {
+}
+
+FrameArchiveWriter::~FrameArchiveWriter() {
+    close();
+}
+
+/**
+ * Open the archive file of the given day for appending.
+ * An existing file is truncated behind its last record, the index is rebuilt.
+ */
+bool FrameArchiveWriter::open(const std::string & day) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    std::string path = _dir + "/" + day + FRAMEARCHIVE_EXTENSION;
+
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd == -1) {
+        rlog << log4cpp::Priority::ERROR << "Can't open archive " << path << " :" << std::strerror(errno);
+        return false;
+    }
+    _day = day;
+    _index.clear();
+
+    struct stat st;
+    fstat(_fd, &st);
+    if (st.st_size > 0) {
+        void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+        bool valid = p != MAP_FAILED && parseArchive((const unsigned char *) p, st.st_size, _index, _end);
+        if (p != MAP_FAILED) {
+            munmap(p, st.st_size);
+        }
+        if (!valid) {
+            rlog << log4cpp::Priority::ERROR << "Not a frame archive: " << path;
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+        // drop old index and footer or a partially written record
+        if (ftruncate(_fd, _end) == -1) {
+            rlog << log4cpp::Priority::ERROR << "Can't truncate archive " << path << " :" << std::strerror(errno);
+        }
+        rlog << log4cpp::Priority::INFO << "Appending to archive " << path << " with " << _index.size() << " frames";
+    } else {
+        FrameArchiveHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        header.version = ARCHIVE_VERSION;
+        if (pwrite(_fd, &header, sizeof(header), 0) != sizeof(header)) {
+            rlog << log4cpp::Priority::ERROR << "Can't write archive " << path << " :" << std::strerror(errno);
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+        _end = sizeof(header);
+    }
+    return true;
+}
+
+/**
+ * Write the trailing index and close the current file.
+ */
+void FrameArchiveWriter::close() {
+    if (_fd == -1) {
+        return;
+    }
+    FrameArchiveFooter footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.indexOffset = _end;
+    footer.count = _index.size();
+    footer.magic = FOOTER_MAGIC;
+
+    struct iovec iov[2];
+    iov[0].iov_base = _index.data();
+    iov[0].iov_len = _index.size() * sizeof(FrameIndexEntry);
+    iov[1].iov_base = &footer;
+    iov[1].iov_len = sizeof(footer);
+    if (pwritev(_fd, iov, 2, _end) != (ssize_t) (iov[0].iov_len + iov[1].iov_len)) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't write archive index: " << std::strerror(errno);
+    }
+    ::close(_fd);
+    _fd = -1;
+    _day.clear();
+    _index.clear();
+}
+
+/**
+ * Append a frame. The image is stored as lossless compressed gray image
+ * into the archive file of the day of time.
+ */
+bool FrameArchiveWriter::append(const Timestamp & time, const cv::Mat & img) {
+    struct tm date;
+    time_t sec = time.time();
+    localtime_r(&sec, &date);
+    char day[16];
+    strftime(day, sizeof(day), "%Y%m%d", &date);
+    if (_day != day) {
+        close();
+        if (!open(day)) {
+            return false;
+        }
+    }
+
+    if (img.channels() == 1) {
+        _gray = img;
+    } else {
+#if CV_MAJOR_VERSION == 2
+        cv::cvtColor(img, _gray, CV_BGR2GRAY);
+#elif CV_MAJOR_VERSION == 3 | 4
+        cv::cvtColor(img, _gray, cv::COLOR_BGR2GRAY);
+#endif
+    }
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    params.push_back(1); // fast, the archive is written on the capture path
+    if (!cv::imencode(".png", _gray, _buffer, params)) {
+        return false;
+    }
+
+    FrameRecordHeader record;
+    record.magic = RECORD_MAGIC;
+    record.size = _buffer.size();
+    record.time = time.micros();
+
+    struct iovec iov[2];
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = _buffer.data();
+    iov[1].iov_len = _buffer.size();
+    if (pwritev(_fd, iov, 2, _end) != (ssize_t) (iov[0].iov_len + iov[1].iov_len)) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't write archive: " << std::strerror(errno);
+        return false;
+    }
+    FrameIndexEntry entry = { record.time, _end };
+    _index.push_back(entry);
+    _end += iov[0].iov_len + iov[1].iov_len;
+    return true;
+}
+
+FrameArchiveReader::FrameArchiveReader() :
+    _data(0), _size(0) {
+}
+
+FrameArchiveReader::~FrameArchiveReader() {
+    close();
+}
+
+bool FrameArchiveReader::open(const std::string & path) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        rlog << log4cpp::Priority::ERROR << "Can't open archive " << path << " :" << std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        rlog << log4cpp::Priority::ERROR << "Can't map archive " << path << " :" << std::strerror(errno);
+        return false;
+    }
+    _data = (const unsigned char *) p;
+    _size = st.st_size;
+
+    uint64_t dataEnd;
+    if (!parseArchive(_data, _size, _index, dataEnd)) {
+        rlog << log4cpp::Priority::ERROR << "Not a frame archive: " << path;
+        close();
+        return false;
+    }
+    madvise((void *) _data, _size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void FrameArchiveReader::close() {
+    if (_data) {
+        munmap((void *) _data, _size);
+        _data = 0;
+        _size = 0;
+    }
+    _index.clear();
+}
+
+/**
+ * Index of the first frame not older than time.
+ */
+size_t FrameArchiveReader::lowerBound(time_t time) const {
+    size_t lo = 0, hi = _index.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (_index[mid].time < (int64_t) time * 1000000) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool FrameArchiveReader::read(size_t i, cv::Mat & img) const {
+    if (i >= _index.size()) {
+        return false;
+    }
+    FrameRecordHeader record;
+    memcpy(&record, _data + _index[i].offset, sizeof(record));
+    if (record.magic != RECORD_MAGIC) {
+        return false;
+    }
+    cv::Mat buf(1, record.size, CV_8UC1, (void *) (_data + _index[i].offset + sizeof(record)));
+    img = cv::imdecode(buf, cv::IMREAD_GRAYSCALE);
+    return !img.empty();
+}
@@ -0,0 +1,98 @@
+/*
+ * FrameArchive.h
+ *
+ * Append-only container for captured frames, one file per day.
+ *
+ * File layout:
+ *   FrameArchiveHeader
+ *   { FrameRecordHeader, png encoded gray image }*
+ *   FrameIndexEntry[count]    (written on close)
+ *   FrameArchiveFooter        (written on close)
+ *
+ * A file without footer (writer still active or crashed) is read by
+ * scanning the records from the start.
+ * Times are microseconds since epoch.
+ */
+
+#ifndef FRAMEARCHIVE_H_
+#define FRAMEARCHIVE_H_
+
+#include <stdint.h>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Timestamp.h"
+
+#define FRAMEARCHIVE_EXTENSION ".fra"
+
+struct FrameArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct FrameRecordHeader {
+    uint32_t magic;
+    uint32_t size;
+    int64_t time;
+};
+
+struct FrameIndexEntry {
+    int64_t time;
+    uint64_t offset; // offset of the FrameRecordHeader
+};
+
+struct FrameArchiveFooter {
+    uint64_t indexOffset;
+    uint64_t count;
+    uint32_t magic;
+    uint32_t reserved;
+};
+
+class FrameArchiveWriter {
+public:
+    FrameArchiveWriter(const std::string & dir);
+    ~FrameArchiveWriter();
+
+    bool append(const Timestamp & time, const cv::Mat & img);
+    void close();
+
+private:
+    bool open(const std::string & day);
+
+    std::string _dir;
+    std::string _day;
+    int _fd;
+    uint64_t _end;
+    std::vector<FrameIndexEntry> _index;
+    std::vector<unsigned char> _buffer;
+    cv::Mat _gray;
+};
+
+class FrameArchiveReader {
+public:
+    FrameArchiveReader();
+    ~FrameArchiveReader();
+
+    bool open(const std::string & path);
+    void close();
+
+    size_t count() const {
+        return _index.size();
+    }
+    Timestamp time(size_t i) const {
+        return Timestamp::fromMicros(_index[i].time);
+    }
+    size_t lowerBound(time_t time) const;
+    bool read(size_t i, cv::Mat & img) const;
+
+private:
+    const unsigned char * _data;
+    size_t _size;
+    std::vector<FrameIndexEntry> _index;
+};
+
+#endif /* FRAMEARCHIVE_H_ */
@@ -0,0 +1,74 @@
+/*
+ * FrameQuality.cpp
+ *
+ */
+
+#include "FrameQuality.h"
+
+static const char * defectNames[] = {
+    "ok", "dark", "bright", "blurry", "edges"
+};
+
+const char * FrameQuality::defectName(FrameDefect defect) {
+    return defectNames[defect];
+}
+
+FrameDefect FrameQuality::check(const cv::Mat & img, const Config & config) {
+    // area interpolation, nearest neighbors would add edges
+    double scale = (double) THUMBNAIL_WIDTH / img.cols;
+    if (scale < 1.) {
+        cv::resize(img, _thumb, cv::Size(), scale, scale, cv::INTER_AREA);
+    } else {
+        _thumb = img;
+    }
+    if (_thumb.channels() == 1) {
+        _gray = _thumb;
+    } else {
+#if CV_MAJOR_VERSION == 2
+        cvtColor(_thumb, _gray, CV_BGR2GRAY);
+#elif CV_MAJOR_VERSION == 3 | 4
+        cvtColor(_thumb, _gray, cv::COLOR_BGR2GRAY);
+#endif
+    }
+
+    int hist[256] = { 0 };
+    for (int y = 0; y < _gray.rows; ++y) {
+        const uchar * p = _gray.ptr<uchar>(y);
+        for (int x = 0; x < _gray.cols; ++x) {
+            ++hist[p[x]];
+        }
+    }
+    double total = _gray.rows * _gray.cols;
+    double sum = 0.;
+    int saturated = 0;
+    for (int v = 0; v < 256; ++v) {
+        sum += (double) v * hist[v];
+        if (v >= 250) {
+            saturated += hist[v];
+        }
+    }
+    _stats.mean = sum / total;
+    _stats.saturated = saturated / total;
+
+    cv::Laplacian(_gray, _laplacian, CV_16S);
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(_laplacian, mean, stddev);
+    _stats.sharpness = stddev[0] * stddev[0];
+
+    cv::Canny(_gray, _edges, config.getCannyThreshold1(), config.getCannyThreshold2());
+    _stats.edges = cv::countNonZero(_edges) / total;
+
+    if (_stats.mean < config.getQualityMinMean()) {
+        return FRAME_DARK;
+    }
+    if (_stats.mean > config.getQualityMaxMean() || _stats.saturated > config.getQualityMaxSaturated()) {
+        return FRAME_BRIGHT;
+    }
+    if (_stats.edges < config.getQualityMinEdges() || _stats.edges > config.getQualityMaxEdges()) {
+        return FRAME_EDGES;
+    }
+    if (_stats.sharpness < config.getQualityMinSharpness()) {
+        return FRAME_BLURRY;
+    }
+    return FRAME_OK;
+}
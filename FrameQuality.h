@@ -0,0 +1,58 @@
+/*
+ * FrameQuality.h
+ *
+ * Cheap check of an image on a thumbnail before the image processing:
+ * brightness and share of saturated pixels from the histogram, sharpness
+ * as variance of the Laplacian and the share of edge pixels, too few edges
+ * mean the counter is not in the image.
+ *
+ */
+
+#ifndef FRAMEQUALITY_H_
+#define FRAMEQUALITY_H_
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Config.h"
+
+enum FrameDefect {
+    FRAME_OK,
+    FRAME_DARK,
+    FRAME_BRIGHT,
+    FRAME_BLURRY,
+    FRAME_EDGES
+};
+
+struct FrameQualityStats {
+    // mean gray value 0..255
+    double mean;
+    // share of pixels >= 250
+    double saturated;
+    // variance of the Laplacian
+    double sharpness;
+    // share of edge pixels
+    double edges;
+};
+
+class FrameQuality {
+public:
+    enum { THUMBNAIL_WIDTH = 160 };
+
+    FrameDefect check(const cv::Mat & img, const Config & config);
+
+    const FrameQualityStats & stats() const {
+        return _stats;
+    }
+
+    static const char * defectName(FrameDefect defect);
+
+private:
+    // kept to reuse the buffers
+    cv::Mat _thumb;
+    cv::Mat _gray;
+    cv::Mat _laplacian;
+    cv::Mat _edges;
+    FrameQualityStats _stats;
+};
+
+#endif /* FRAMEQUALITY_H_ */
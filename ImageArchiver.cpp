@@ -0,0 +1,175 @@
+/*
+ * ImageArchiver.cpp
+ *
+ */
+
+#include <string>
+#include <list>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/statvfs.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "ImageArchiver.h"
+#include "Directory.h"
+
+ImageArchiver::ImageArchiver(const Config & config) :
+    _extension("." + config.getImageFormat()),
+    _maxQueue(config.getArchiveQueueSize()),
+    _snapshotMaxFiles(config.getSnapshotMaxFiles()),
+    _snapshotMinFreeMB(config.getSnapshotMinFreeMB()),
+    _busy(false), _exit(false), _dropped(0) {
+    if (config.getImageFormat() == "png") {
+        _params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        _params.push_back(config.getImageQuality());
+    } else if (config.getImageFormat() == "jpg") {
+        _params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        _params.push_back(config.getImageQuality());
+    }
+    _thread = std::thread(&ImageArchiver::run, this);
+}
+
+/**
+ * Write all queued images and stop the thread.
+ */
+ImageArchiver::~ImageArchiver() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _exit = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+}
+
+/**
+ * Queue image for writing to dir as <YYYYMMDD-HHMMSS-mmm>.<imageFormat>.
+ * Snapshots are subject to the retention policy of snapshotMaxFiles and snapshotMinFreeMB.
+ */
+bool ImageArchiver::save(const cv::Mat & img, const Timestamp & time, const std::string & dir, bool snapshot) {
+    Job job = { cv::Mat(), time, dir, snapshot, 0 };
+    job.img = img;
+    return enqueue(job);
+}
+
+/**
+ * Queue image for appending to a frame archive.
+ */
+bool ImageArchiver::archive(const cv::Mat & img, const Timestamp & time, FrameArchiveWriter * writer) {
+    Job job = { cv::Mat(), time, "", false, writer };
+    job.img = img;
+    return enqueue(job);
+}
+
+/**
+ * Wait until the queue is empty, e.g. before closing a frame archive.
+ */
+void ImageArchiver::flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_queue.empty() || _busy) {
+        _idle.wait(lock);
+    }
+}
+
+/**
+ * Never blocks: if the queue is full the image is dropped.
+ */
+bool ImageArchiver::enqueue(const Job & job) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_queue.size() >= _maxQueue) {
+        ++_dropped;
+        lock.unlock();
+        log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Image queue full, dropped image (" << _dropped << " total)";
+        return false;
+    }
+    _queue.push_back(job);
+    // the input may reuse its buffer for the next frame
+    _queue.back().img = job.img.clone();
+    lock.unlock();
+    _cond.notify_one();
+    return true;
+}
+
+void ImageArchiver::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        if (_queue.empty()) {
+            _idle.notify_all();
+            if (_exit) {
+                break;
+            }
+            _cond.wait(lock);
+            continue;
+        }
+        Job job = _queue.front();
+        _queue.pop_front();
+        _busy = true;
+        lock.unlock();
+        write(job);
+        lock.lock();
+        _busy = false;
+    }
+}
+
+void ImageArchiver::write(const Job & job) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+
+    if (job.writer) {
+        if (job.writer->append(job.time, job.img)) {
+            rlog << log4cpp::Priority::INFO << "Image archived";
+        }
+        return;
+    }
+
+    // milliseconds keep the names of several images per second unique
+    std::string name = job.time.format("%Y%m%d-%H%M%S", "-") + _extension;
+
+    if (job.snapshot) {
+        applyRetention(job.dir, name);
+    }
+    std::string path = job.dir + "/" + name;
+    if (cv::imwrite(path, job.img, _params)) {
+        rlog << log4cpp::Priority::INFO << "Image saved to " + path;
+    } else {
+        rlog << log4cpp::Priority::ERROR << "Can't save image to " + path;
+    }
+}
+
+/**
+ * Remove the oldest snapshots of dir if there are more than snapshotMaxFiles
+ * or less than snapshotMinFreeMB free disk space.
+ */
+void ImageArchiver::applyRetention(const std::string & dir, const std::string & filename) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+
+    std::map<std::string, std::deque<std::string> >::iterator it = _snapshots.find(dir);
+    if (it == _snapshots.end()) {
+        // first snapshot into dir: take over existing files
+        Directory directory(dir.c_str(), _extension.c_str());
+        std::list<std::string> names = directory.list();
+        names.sort();
+        it = _snapshots.insert(std::make_pair(dir, std::deque<std::string>(names.begin(), names.end()))).first;
+    }
+    std::deque<std::string> & files = it->second;
+    if (files.empty() || files.back() != filename) {
+        files.push_back(filename);
+    }
+
+    while (_snapshotMaxFiles > 0 && files.size() > _snapshotMaxFiles) {
+        unlink((dir + "/" + files.front()).c_str());
+        files.pop_front();
+    }
+
+    struct statvfs vfs;
+    while (_snapshotMinFreeMB > 0 && files.size() > 1 && 0 == statvfs(dir.c_str(), &vfs)
+            && (unsigned long long) vfs.f_bavail * vfs.f_frsize < _snapshotMinFreeMB * 1024ULL * 1024ULL) {
+        rlog << log4cpp::Priority::INFO << "Low disk space, remove snapshot " << files.front();
+        unlink((dir + "/" + files.front()).c_str());
+        files.pop_front();
+    }
+}
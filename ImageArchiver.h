@@ -0,0 +1,70 @@
+/*
+ * ImageArchiver.h
+ *
+ * Background thread that writes image files and frame archives,
+ * so that image compression does not block the processing loop.
+ *
+ */
+
+#ifndef IMAGEARCHIVER_H_
+#define IMAGEARCHIVER_H_
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Config.h"
+#include "FrameArchive.h"
+#include "Timestamp.h"
+
+class ImageArchiver {
+public:
+    ImageArchiver(const Config & config);
+    ~ImageArchiver();
+
+    bool save(const cv::Mat & img, const Timestamp & time, const std::string & dir, bool snapshot = false);
+    bool archive(const cv::Mat & img, const Timestamp & time, FrameArchiveWriter * writer);
+    void flush();
+
+    unsigned long getDropped() const {
+        return _dropped;
+    }
+
+private:
+    struct Job {
+        cv::Mat img;
+        Timestamp time;
+        std::string dir;
+        bool snapshot;
+        FrameArchiveWriter * writer;
+    };
+
+    bool enqueue(const Job & job);
+    void run();
+    void write(const Job & job);
+    void applyRetention(const std::string & dir, const std::string & filename);
+
+    std::string _extension;
+    std::vector<int> _params;
+    size_t _maxQueue;
+    size_t _snapshotMaxFiles;
+    unsigned long _snapshotMinFreeMB;
+
+    std::deque<Job> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::condition_variable _idle;
+    bool _busy;
+    bool _exit;
+    unsigned long _dropped;
+    std::map<std::string, std::deque<std::string> > _snapshots;
+    std::thread _thread;
+};
+
+#endif /* IMAGEARCHIVER_H_ */
@@ -10,6 +10,8 @@
 #include <sys/inotify.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/stat.h>
+#include <fstream>
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -18,15 +20,20 @@
 #include <log4cpp/Priority.hh>
 
 #include "ImageInput.h"
+#include "Log.h"
+#include "Metrics.h"
 
 ImageInput::~ImageInput() {
+    // write pending images before closing the archive
+    delete _archiver;
+    delete _archive;
 }
 
 cv::Mat & ImageInput::getImage() {
     return _img;
 }
 
-time_t ImageInput::getTime() {
+Timestamp ImageInput::getTime() {
     return _time;
 }
 
@@ -34,53 +41,115 @@ void ImageInput::setOutputDir(const std::string & outDir) {
     _outDir = outDir;
 }
 
+/**
+ * Save images into packed day archives in archiveDir instead of png files.
+ */
+void ImageInput::setOutputArchive(const std::string & archiveDir) {
+    if (_archiver) {
+        _archiver->flush();
+    }
+    delete _archive;
+    _archive = archiveDir.empty() ? 0 : new FrameArchiveWriter(archiveDir);
+}
+
+/**
+ * Directory for snapshots of single frames, e.g. unrecognized images.
+ */
+void ImageInput::setSnapshotDir(const std::string & snapshotDir) {
+    _snapshotDir = snapshotDir;
+}
+
+/**
+ * Set the archiver that writes images in background, takes ownership.
+ */
+void ImageInput::setArchiver(ImageArchiver * archiver) {
+    delete _archiver;
+    _archiver = archiver;
+}
+
+/**
+ * Waiting inputs return false after their timeout when stop is set,
+ * for inputs that are not read in the main thread.
+ */
+void ImageInput::setStop(const volatile bool * stop) {
+    _stop = stop;
+}
+
+ImageArchiver & ImageInput::archiver() {
+    if (!_archiver) {
+        _archiver = new ImageArchiver(Config());
+    }
+    return *_archiver;
+}
+
+bool ImageInput::isSaving() const {
+    return !_outDir.empty() || _archive;
+}
+
+/**
+ * Read time from file name of format YYYYMMDD-HHMMSS[-mmm], unset if the name has no time.
+ */
+Timestamp ImageInput::parseTime(const std::string & filename) {
+    Timestamp time;
+    Directory::parseTime(filename.c_str(), time);
+    return time;
+}
+
+/**
+ * Only process images with a time in [from, to], to = 0 means no upper limit.
+ */
+void ImageInput::setTimeRange(time_t from, time_t to) {
+    _from = from;
+    _to = to;
+}
+
 void ImageInput::saveImage() {
+    if (_archive) {
+        archiver().archive(_img, _time, _archive);
+        return;
+    }
     if (_outDir.length() == 0) {
         log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Try save image empty path";
         return;
     }
-    struct tm date;
-    localtime_r(&_time, &date);
-    char filename[PATH_MAX];
-    strftime(filename, PATH_MAX, "/%Y%m%d-%H%M%S.png", &date);
-    std::string path = _outDir + filename;
-    if (cv::imwrite(path, _img)) {
-        log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Image saved to " + path;
+    archiver().save(_img, _time, _outDir);
+}
+
+void ImageInput::saveSnapshot() {
+    if (_snapshotDir.length() == 0) {
+        return;
     }
+    archiver().save(_img, _time, _snapshotDir, true);
 }
 
 DirectoryInput::DirectoryInput(const Directory & directory) :
-    _directory(directory) {
-    _filenameList = _directory.list();
-    _filenameList.sort();
-    _itFilename = _filenameList.begin();
+    _directory(directory), _listed(false) {
 }
 
 bool DirectoryInput::nextImage(std::string & path) {
-    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    if (!_listed) {
+        // list on first use to apply the time range while reading the directory
+        _filenameList = _directory.listTimed(_from, _to);
+        _itFilename = _filenameList.begin();
+        _listed = true;
+    }
     if (_itFilename == _filenameList.end()) {
         return false;
     }
-    path = _directory.fullpath(*_itFilename);
-
-    _img = cv::imread(path.c_str());
+    path = _directory.fullpath(_itFilename->name);
 
-    // read time from file name
+    {
+        Trace::beginFrame();
+        StageTimer timer(STAGE_INPUT);
+        _img = cv::imread(path.c_str());
+    }
 
-    struct tm date;
-    memset(&date, 0, sizeof(date));
-    date.tm_year = atoi(_itFilename->substr(0, 4).c_str()) - 1900;
-    date.tm_mon = atoi(_itFilename->substr(4, 2).c_str()) - 1;
-    date.tm_mday = atoi(_itFilename->substr(6, 2).c_str());
-    date.tm_hour = atoi(_itFilename->substr(9, 2).c_str());
-    date.tm_min = atoi(_itFilename->substr(11, 2).c_str());
-    date.tm_sec = atoi(_itFilename->substr(13, 2).c_str());
-    _time = mktime(&date);
+    _time = _itFilename->time;
 
-    rlog << log4cpp::Priority::INFO << "Processing " << *_itFilename << " of " << ctime(&_time);
+    LOG_INFO("Processing %s of %s", _itFilename->name.c_str(), _time.toString().c_str());
 
     // save copy of image if requested
-    if (!_outDir.empty()) {
+    if (isSaving()) {
         saveImage();
     }
 
@@ -93,14 +162,19 @@ CameraInput::CameraInput(int device) {
 }
 
 bool CameraInput::nextImage(std::string & path) {
-    time(&_time);
+    _time = Timestamp::now();
     // read image from camera
-    bool success = _capture.read(_img);
+    bool success;
+    {
+        Trace::beginFrame();
+        StageTimer timer(STAGE_INPUT);
+        success = _capture.read(_img);
+    }
 
-    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Image captured: " << success;
+    LOG_INFO("Image captured: %d", (int) success);
 
     // save copy of image if requested
-    if (success && !_outDir.empty()) {
+    if (success && isSaving()) {
         saveImage();
     }
 
@@ -110,47 +184,225 @@ bool CameraInput::nextImage(std::string & path) {
 
 InotifyInput::InotifyInput(const std::string path, int timeout):
     _path(path),
-    _timeout(timeout) {
+    _timeout(timeout),
+    _recursive(false),
+    _started(false),
+    _buffer(64 * (sizeof(struct inotify_event) + NAME_MAX + 1)) {
 
     log4cpp::Category & rlog = log4cpp::Category::getRoot();
-    _inotifyFd = inotify_init();
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
     if (_inotifyFd == -1) {
         rlog << log4cpp::Priority::ERROR << ": inotify_init error:" << std::strerror(errno);
-    } else {
-        _inotifyWatch = inotify_add_watch(_inotifyFd, _path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
-        if ( _inotifyWatch == -1) {
-            rlog << log4cpp::Priority::ERROR << ": inotify_add_watch: " << _path << " :" << std::strerror(errno);
-        }
     }
 }
 
 InotifyInput::~InotifyInput(void) {
-
-    if (_inotifyWatch != -1) {
-        inotify_rm_watch(_inotifyFd, _inotifyWatch);
+    if (!_current.empty()) {
+        _lastProcessed = _current;
     }
+    saveState(true);
 
     if (_inotifyFd != -1) {
+        // closing the descriptor removes all watches
         close(_inotifyFd);
     }
+}
+
+/**
+ * Watch subdirectories, e.g. per day directories of the capture cameras.
+ */
+void InotifyInput::setRecursive(bool recursive) {
+    _recursive = recursive;
+}
+
+/**
+ * File to keep the name of the last processed image.
+ * Images written while emeocv was not running are processed on the next start.
+ */
+void InotifyInput::setStateFile(const std::string & stateFile) {
+    _stateFile = stateFile;
+}
+
+/**
+ * Add the watches and scan for images that were written since the last processed one.
+ * Watches are added before scanning, so that no image is lost in between.
+ */
+void InotifyInput::start() {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    _started = true;
 
+    if (!_stateFile.empty()) {
+        std::ifstream state(_stateFile.c_str());
+        std::getline(state, _lastProcessed);
+    }
+    // without a processed image the images already in the directory are not queued
+    _scanAfter = Timestamp::now();
+    if (!_lastProcessed.empty() && !Directory::parseTime(_lastProcessed.c_str(), _scanAfter)) {
+        _lastProcessed.clear();
+    }
+    addWatch("");
+    if (!_lastProcessed.empty()) {
+        scan("");
+        rlog << log4cpp::Priority::INFO << "Catch up " << _files.size() << " images after " << _lastProcessed;
+    }
+}
+
+void InotifyInput::addWatch(const std::string & dir) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    std::string fullpath = dir.empty() ? _path : _path + "/" + dir;
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+    if (_recursive) {
+        mask |= IN_CREATE;
+    }
+    int wd = inotify_add_watch(_inotifyFd, fullpath.c_str(), mask);
+    if (wd == -1) {
+        rlog << log4cpp::Priority::ERROR << ": inotify_add_watch: " << fullpath << " :" << std::strerror(errno);
+        return;
+    }
+    _watches[wd] = dir;
+
+    if (_recursive) {
+        Directory directory(fullpath.c_str(), ".png");
+        std::list<std::string> subdirs = directory.listDirectories();
+        for (std::list<std::string>::const_iterator it = subdirs.begin(); it != subdirs.end(); ++it) {
+            addWatch(dir.empty() ? *it : dir + "/" + *it);
+        }
+    }
+}
+
+/**
+ * Images are named by their time, dot files (e.g. temporary files of writers) and
+ * other names are skipped.
+ */
+static bool parseImageName(const char * name, TimedFile & file) {
+    if (name[0] == '.' || !Directory::hasExtension(name, ".png") || !Directory::parseTime(name, file.time)) {
+        return false;
+    }
+    file.name = name;
+    return true;
+}
+
+/**
+ * Queue all images in dir (and subdirectories if recursive) newer than the last processed one,
+ * or than the start of the watch if there is none.
+ */
+void InotifyInput::scan(const std::string & dir) {
+    std::string fullpath = dir.empty() ? _path : _path + "/" + dir;
+    Directory directory(fullpath.c_str(), ".png");
+    std::list<std::string> names = directory.list();
+    TimedFile file;
+    for (std::list<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        // compare the times, "...-120000-500.png" sorts before "...-120000.png"
+        if (parseImageName(it->c_str(), file) && _scanAfter < file.time) {
+            _files.insert(std::make_pair(file, dir));
+        }
+    }
+    if (_recursive) {
+        std::list<std::string> subdirs = directory.listDirectories();
+        for (std::list<std::string>::const_iterator it = subdirs.begin(); it != subdirs.end(); ++it) {
+            scan(dir.empty() ? *it : dir + "/" + *it);
+        }
+    }
+}
+
+/**
+ * Read all pending events without blocking.
+ */
+bool InotifyInput::readEvents() {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    TimedFile file;
+
+    while (true) {
+        ssize_t numRead = read(_inotifyFd, _buffer.data(), _buffer.size());
+
+        if (numRead == -1 && errno == EAGAIN) {
+            return true;
+        }
+        if (numRead == 0) {
+            return false;
+        }
+        if (numRead == -1) {
+            rlog << log4cpp::Priority::ERROR << ": read error:" << std::strerror(errno);
+            return false;
+        }
+
+        for (char * p = _buffer.data(); p < _buffer.data() + numRead; ) {
+            struct inotify_event * event = (struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // without a processed image yet the images since the start of the watch are queued
+                rlog << log4cpp::Priority::WARN << "inotify queue overflow, rescan " << _path
+                     << (_lastProcessed.empty() ? "" : " after " + _lastProcessed);
+                scan("");
+                continue;
+            }
+            std::map<int, std::string>::const_iterator itWatch = _watches.find(event->wd);
+            if (itWatch == _watches.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                _watches.erase(event->wd);
+                continue;
+            }
+            const std::string & dir = itWatch->second;
+            if ((event->mask & IN_ISDIR) && _recursive) {
+                std::string subdir = dir.empty() ? event->name : dir + "/" + event->name;
+                addWatch(subdir);
+                // images may have been written before the watch was added
+                scan(subdir);
+            } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && parseImageName(event->name, file)) {
+                _files.insert(std::make_pair(file, dir));
+            }
+        }
+    }
 }
 
-#define BUF_LEN (10 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+/**
+ * Write the name of the last processed image, at most once a minute.
+ */
+void InotifyInput::saveState(bool force) {
+    if (_stateFile.empty() || _lastProcessed.empty() || (!force && _time - _stateSaved < 60)) {
+        return;
+    }
+    _stateSaved = _time;
+    std::string tmpFile = _stateFile + ".tmp";
+    std::ofstream state(tmpFile.c_str());
+    state << _lastProcessed << std::endl;
+    state.close();
+    if (!state || rename(tmpFile.c_str(), _stateFile.c_str()) != 0) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't write " << _stateFile << " :" << std::strerror(errno);
+    }
+}
 
 bool InotifyInput::nextImage(std::string & path) {
-    char buf[BUF_LEN] __attribute__ ((aligned(8)));
     struct pollfd fds[1];
     fds[0].fd = _inotifyFd;
     fds[0].events = POLLIN;
 
     log4cpp::Category & rlog = log4cpp::Category::getRoot();
 
+    if (!_started) {
+        start();
+    }
+    // the previous image is processed now
+    if (!_current.empty()) {
+        _lastProcessed = _current;
+        _scanAfter = _time;
+        saveState(false);
+    }
+
+    if (!readEvents()) {
+        return false;
+    }
     while (_files.empty()) {
         int poll_ret = poll(fds, 1,  _timeout);
 
         if (poll_ret == 0) { // timeout
+            if (isStopped()) {
+                return false;
+            }
             continue;
         }
 
@@ -158,56 +410,264 @@ bool InotifyInput::nextImage(std::string & path) {
             rlog << log4cpp::Priority::ERROR << ": poll error:" << std::strerror(errno);
             return false;
         }
-        bzero(buf, sizeof(buf));
-        int numRead = read(_inotifyFd, buf, BUF_LEN);
-
-        if (numRead == 0) {
+        if (!readEvents()) {
             return false;
         }
+    }
 
-        if (numRead == -1) {
-            rlog << log4cpp::Priority::ERROR << ": read error:" << std::strerror(errno);
+    std::set<std::pair<TimedFile, std::string> >::iterator itFile = _files.begin();
+    _current = itFile->first.name;
+    _time = itFile->first.time;
+    path = itFile->second.empty() ? _path + "/" + _current : _path + "/" + itFile->second + "/" + _current;
+    _files.erase(itFile);
+
+    {
+        Trace::beginFrame();
+        StageTimer timer(STAGE_INPUT);
+        _img = cv::imread(path.c_str());
+    }
+
+    LOG_INFO("Processing %s of %s", path.c_str(), _time.toString().c_str());
+
+    return true;
+}
+
+ShmInput::ShmInput(const std::string & name, int timeout):
+    _name(name),
+    _timeout(timeout),
+    _attached(false),
+    _waiting(false),
+    _readIndex(0) {
+    attach();
+}
+
+bool ShmInput::attach() {
+    if (!_ring.open(_name)) {
+        // retried every timeout until the writer starts, log only once
+        if (!_waiting) {
+            log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Waiting for shared memory " << _name
+                                         << ": " << std::strerror(errno);
+            _waiting = true;
+        }
+        return false;
+    }
+    _attached = true;
+    _waiting = false;
+    // start with the next frame written, do not replay old ring content
+    _readIndex = __atomic_load_n(&_ring.header()->writeIndex, __ATOMIC_ACQUIRE);
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Attached to shared memory " << _name
+                                 << " with " << _ring.header()->slots << " slots";
+    return true;
+}
+
+/**
+ * Copy frame number index out of the ring into _img.
+ * Returns false if the slot was overwritten by the writer while reading.
+ */
+bool ShmInput::readFrame(uint64_t index) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    Trace::beginFrame();
+    StageTimer timer(STAGE_INPUT);
+    ShmFrameHeader * frame = _ring.slot(index);
+
+    uint64_t seq = __atomic_load_n(&frame->seq, __ATOMIC_ACQUIRE);
+    ShmFrameHeader hdr = *frame;
+    if ((seq & 1) || hdr.index != index) {
+        return false;
+    }
+    if (hdr.size > ShmRing::maxDataSize(_ring.header()->slotSize)) {
+        return false;
+    }
+    unsigned char * data = (unsigned char *) (frame + 1);
+
+    switch (hdr.format) {
+    case SHM_FORMAT_GREY:
+    case SHM_FORMAT_I420: // the Y plane of I420 is a grey image
+        if ((uint64_t) hdr.stride * hdr.height > hdr.size || hdr.stride < hdr.width) {
+            return false;
+        }
+        cv::Mat(hdr.height, hdr.width, CV_8UC1, data, hdr.stride).copyTo(_img);
+        break;
+    case SHM_FORMAT_YUYV:
+        if ((uint64_t) hdr.stride * hdr.height > hdr.size || hdr.stride < 2 * hdr.width) {
             return false;
         }
+#if CV_MAJOR_VERSION == 2
+        cv::cvtColor(cv::Mat(hdr.height, hdr.width, CV_8UC2, data, hdr.stride), _img, CV_YUV2GRAY_YUYV);
+#elif CV_MAJOR_VERSION == 3 | 4
+        cv::cvtColor(cv::Mat(hdr.height, hdr.width, CV_8UC2, data, hdr.stride), _img, cv::COLOR_YUV2GRAY_YUYV);
+#endif
+        break;
+    default:
+        rlog << log4cpp::Priority::ERROR << "Unknown shared memory frame format " << hdr.format;
+        return false;
+    }
 
-        for (char * p = buf; p < buf + numRead; ) {
-            struct inotify_event * event = (struct inotify_event *) p;
-            if (Directory::hasExtension(event->name, ".png")) {
-                /*                printf("%s %s %s %x\n", event->name,
-                                       event->mask & IN_CLOSE_WRITE? "IN_CLOSE_WRITE":"",
-                                       event->mask & IN_MOVED_TO? "IN_MOVED_TO":"",
-                                       event->mask);*/
-                _files.push_back(std::string(event->name));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&frame->seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+    _time = Timestamp::fromTime(hdr.timeSec, hdr.timeNsec / 1000);
+    return true;
+}
+
+bool ShmInput::nextImage(std::string & path) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+
+    while (true) {
+        if (isStopped()) {
+            return false;
+        }
+        if (!_attached && !attach()) {
+            // writer not yet started
+            usleep(_timeout * 1000L);
+            continue;
+        }
+        ShmRingHeader * header = _ring.header();
+        // read the futex word before the write index to not miss a wakeup
+        uint32_t frameCount = __atomic_load_n(&header->frameCount, __ATOMIC_ACQUIRE);
+        uint64_t writeIndex = __atomic_load_n(&header->writeIndex, __ATOMIC_ACQUIRE);
+
+        if (writeIndex < _readIndex) {
+            // writer was restarted on the same segment
+            _readIndex = writeIndex;
+        }
+        if (_readIndex < writeIndex) {
+            if (writeIndex - _readIndex >= header->slots) {
+                uint64_t next = writeIndex - header->slots + 1;
+                LOG_WARN("Shared memory reader too slow, skipped %llu frames", (unsigned long long) (next - _readIndex));
+                _readIndex = next;
             }
-            p += sizeof(struct inotify_event) + event->len;
+            if (readFrame(_readIndex++)) {
+                path = _name;
+                LOG_INFO("Processing frame %llu of %s", (unsigned long long) (_readIndex - 1), _time.toString().c_str());
+                if (isSaving()) {
+                    saveImage();
+                }
+                return true;
+            }
+            rlog << log4cpp::Priority::WARN << "Shared memory frame " << (_readIndex - 1) << " overwritten while reading";
+            continue;
         }
-        if (!_files.empty()) {
-            _files.sort();
-            break;
+
+        if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)) {
+            rlog << log4cpp::Priority::INFO << "Shared memory writer closed " << _name;
+            return false;
+        }
+
+        if (_ring.wait(frameCount, _timeout) < 0) {
+            rlog << log4cpp::Priority::ERROR << ": futex wait error:" << std::strerror(errno);
+            return false;
         }
     }
+}
 
-    if (_files.empty()) {
-        return false;
+/**
+ * Read frames from a single archive file or from all archive files of a directory.
+ */
+ArchiveInput::ArchiveInput(const std::string & path):
+    _pos(0) {
+    struct stat st;
+    if (0 == stat(path.c_str(), &st) && S_ISDIR(st.st_mode)) {
+        Directory directory(path.c_str(), FRAMEARCHIVE_EXTENSION);
+        std::list<std::string> names = directory.list();
+        names.sort();
+        for (std::list<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+            _files.push_back(directory.fullpath(*it));
+        }
+    } else {
+        _files.push_back(path);
     }
+    _itFile = _files.begin();
+    openFile();
+}
 
-    path = _path + "/" + _files.front();
-    auto _itFilename = _files.front();
-    _files.pop_front();
+/**
+ * Open the archive file at _itFile, skip files that can't be read.
+ */
+bool ArchiveInput::openFile() {
+    _pos = 0;
+    for (; _itFile != _files.end(); ++_itFile) {
+        if (_reader.open(*_itFile)) {
+            log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Reading archive " << *_itFile
+                                         << " with " << _reader.count() << " frames";
+            return true;
+        }
+    }
+    _reader.close();
+    return false;
+}
 
-    _img = cv::imread(path.c_str());
+/**
+ * Position the input at the first frame not older than time.
+ */
+void ArchiveInput::seek(time_t time) {
+    for (_itFile = _files.begin(); openFile(); ++_itFile) {
+        if (_reader.count() > 0 && _reader.time(_reader.count() - 1).time() >= time) {
+            _pos = _reader.lowerBound(time);
+            return;
+        }
+    }
+}
 
-    struct tm date;
-    memset(&date, 0, sizeof(date));
-    date.tm_year = atoi(_itFilename.substr(0, 4).c_str()) - 1900;
-    date.tm_mon = atoi(_itFilename.substr(4, 2).c_str()) - 1;
-    date.tm_mday = atoi(_itFilename.substr(6, 2).c_str());
-    date.tm_hour = atoi(_itFilename.substr(9, 2).c_str());
-    date.tm_min = atoi(_itFilename.substr(11, 2).c_str());
-    date.tm_sec = atoi(_itFilename.substr(13, 2).c_str());
-    _time = mktime(&date);
+void ArchiveInput::setTimeRange(time_t from, time_t to) {
+    ImageInput::setTimeRange(from, to);
+    if (from) {
+        seek(from);
+    }
+}
 
-    rlog << log4cpp::Priority::INFO << log4cpp::Priority::INFO << "Processing " << path << " of " << ctime(&_time);
+bool ArchiveInput::nextImage(std::string & path) {
+    while (_itFile != _files.end()) {
+        if (_pos < _reader.count()) {
+            size_t pos = _pos++;
+            if (_to && _reader.time(pos).time() > _to) {
+                _itFile = _files.end();
+                break;
+            }
+            bool decoded;
+            {
+                Trace::beginFrame();
+                StageTimer timer(STAGE_INPUT);
+                decoded = _reader.read(pos, _img);
+            }
+            if (!decoded) {
+                log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't decode frame " << pos << " of " << *_itFile;
+                continue;
+            }
+            _time = _reader.time(pos);
+            path = *_itFile;
+            LOG_INFO("Processing frame %zu of %s", pos, _time.toString().c_str());
+            if (isSaving()) {
+                saveImage();
+            }
+            return true;
+        }
+        ++_itFile;
+        openFile();
+    }
+    return false;
+}
+
+SyntheticInput::SyntheticInput(const MeterStyle & style, size_t count) :
+    _renderer(style, Timestamp::now()), _count(count), _rendered(0) {
+}
 
+bool SyntheticInput::nextImage(std::string & path) {
+    if (isStopped() || (_count && _rendered >= _count)) {
+        return false;
+    }
+    {
+        Trace::beginFrame();
+        StageTimer timer(STAGE_INPUT);
+        _renderer.next(_img);
+    }
+    ++_rendered;
+    _time = _renderer.time();
+    path = "synthetic";
+    LOG_INFO("Processing synthetic %s of %s", _renderer.digits().c_str(), _time.toString().c_str());
+    if (isSaving()) {
+        saveImage();
+    }
     return true;
 }
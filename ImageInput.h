@@ -9,11 +9,19 @@
 #include <ctime>
 #include <string>
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
 #include "Directory.h"
+#include "ShmRing.h"
+#include "FrameArchive.h"
+#include "ImageArchiver.h"
+#include "MeterRenderer.h"
+#include "Timestamp.h"
 
 class ImageInput {
 public:
@@ -22,14 +30,34 @@ public:
     virtual bool nextImage(std::string & path) = 0;
 
     virtual cv::Mat & getImage();
-    virtual time_t getTime();
+    virtual Timestamp getTime();
     virtual void setOutputDir(const std::string & outDir);
+    virtual void setOutputArchive(const std::string & archiveDir);
+    virtual void setSnapshotDir(const std::string & snapshotDir);
+    virtual void setArchiver(ImageArchiver * archiver);
     virtual void saveImage();
+    virtual void saveSnapshot();
+    virtual void setTimeRange(time_t from, time_t to);
+    void setStop(const volatile bool * stop);
+
+    static Timestamp parseTime(const std::string & filename);
 
 protected:
+    bool isSaving() const;
+    bool isStopped() const {
+        return _stop && *_stop;
+    }
+    ImageArchiver & archiver();
+
     cv::Mat _img;
-    time_t _time;
+    Timestamp _time;
     std::string _outDir = "";
+    std::string _snapshotDir = "";
+    time_t _from = 0;
+    time_t _to = 0;
+    FrameArchiveWriter * _archive = 0;
+    ImageArchiver * _archiver = 0;
+    const volatile bool * _stop = 0;
 };
 
 class DirectoryInput: public ImageInput {
@@ -40,8 +68,9 @@ public:
 
 private:
     Directory _directory;
-    std::list<std::string>::const_iterator _itFilename;
-    std::list<std::string> _filenameList;
+    bool _listed;
+    std::vector<TimedFile>::const_iterator _itFilename;
+    std::vector<TimedFile> _filenameList;
 };
 
 class CameraInput: public ImageInput {
@@ -58,14 +87,90 @@ class InotifyInput: public ImageInput {
 public:
     InotifyInput(const std::string path, int timeout);
     ~InotifyInput();
+    void setRecursive(bool recursive);
+    void setStateFile(const std::string & stateFile);
     virtual bool nextImage(std::string & path);
 
 private:
+    void start();
+    void addWatch(const std::string & dir);
+    void scan(const std::string & dir);
+    bool readEvents();
+    void saveState(bool force);
+
     std::string _path;
     int _inotifyFd;
-    int _inotifyWatch;
     int _timeout;
+    bool _recursive;
+    bool _started;
+    std::string _stateFile;
+    std::string _current;
+    std::string _lastProcessed;
+    // scan() queues images after this time: the last processed one, else the start of the watch
+    Timestamp _scanAfter;
+    Timestamp _stateSaved;
+    // watch descriptor -> directory relative to _path
+    std::map<int, std::string> _watches;
+    // pending files as (file, directory) ordered by the time in the file name
+    std::set<std::pair<TimedFile, std::string> > _files;
+    std::vector<char> _buffer;
+};
+
+class ShmInput: public ImageInput {
+public:
+    ShmInput(const std::string & name, int timeout);
+
+    virtual bool nextImage(std::string & path);
+
+private:
+    bool attach();
+    bool readFrame(uint64_t index);
+
+    std::string _name;
+    int _timeout;
+    ShmRing _ring;
+    bool _attached;
+    // writer not started, already logged
+    bool _waiting;
+    uint64_t _readIndex;
+};
+
+class ArchiveInput: public ImageInput {
+public:
+    ArchiveInput(const std::string & path);
+
+    void seek(time_t time);
+    virtual void setTimeRange(time_t from, time_t to);
+    virtual bool nextImage(std::string & path);
+
+private:
+    bool openFile();
+
     std::list<std::string> _files;
+    std::list<std::string>::const_iterator _itFile;
+    FrameArchiveReader _reader;
+    size_t _pos;
+};
+
+/**
+ * Rendered images of a counter with known digits.
+ */
+class SyntheticInput: public ImageInput {
+public:
+    // count = 0: endless
+    SyntheticInput(const MeterStyle & style, size_t count);
+
+    virtual bool nextImage(std::string & path);
+
+    // digits shown in the current image
+    const std::string & getDigits() const {
+        return _renderer.digits();
+    }
+
+private:
+    MeterRenderer _renderer;
+    size_t _count;
+    size_t _rendered;
 };
 
 #endif /* IMAGEINPUT_H_ */
@@ -9,11 +9,10 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
-#include <log4cpp/Category.hh>
-#include <log4cpp/Priority.hh>
-
 #include "ImageProcessor.h"
 #include "Config.h"
+#include "Log.h"
+#include "Metrics.h"
 
 /**
  * Functor to help sorting rectangles by their x-position.
@@ -29,6 +28,13 @@ ImageProcessor::ImageProcessor(const Config & config) :
     _config(config), _debugWindow(false), _debugSkew(false), _debugEdges(false), _debugDigits(false)  {
 }
 
+/**
+ * Take over a reloaded config, used from the next image on.
+ */
+void ImageProcessor::setConfig(const Config & config) {
+    _config = config;
+}
+
 /**
  * Set the input image.
  */
@@ -68,20 +74,66 @@ void ImageProcessor::showImage() {
     cv::waitKey(1);
 }
 
+/**
+ * Quality check of the input image before process(), see qualityGate.
+ * Returns false if the image should not be processed, the output is empty then.
+ */
+bool ImageProcessor::checkQuality() {
+    std::string gate = _config.getQualityGate();
+    if (gate == "off") {
+        return true;
+    }
+    FrameDefect defect;
+    {
+        StageTimer timer(STAGE_QUALITY);
+        defect = _quality.check(_img, _config);
+    }
+    if (defect == FRAME_OK) {
+        return true;
+    }
+    const FrameQualityStats & stats = _quality.stats();
+    Metrics::get().count((MetricsCounter) (COUNTER_QUALITY_DARK + defect - FRAME_DARK));
+    LOG_INFO("Frame quality %s: mean %.0f, saturated %.3f, sharpness %.0f, edges %.3f",
+             FrameQuality::defectName(defect), stats.mean, stats.saturated, stats.sharpness, stats.edges);
+    if (gate != "reject") {
+        return true;
+    }
+    Metrics::get().count(COUNTER_QUALITY_SKIPPED);
+    _digits.clear();
+    _rois.clear();
+    return false;
+}
+
 /**
  * Main processing function.
  * Read input image and create vector of images for each digit.
  */
 void ImageProcessor::process() {
+    StageTimer timer(STAGE_PROCESS);
+    Metrics::get().count(COUNTER_FRAMES);
     _digits.clear();
     _rois.clear();
 
-    // convert to gray
+    // convert to gray, inputs like ShmInput already deliver gray images
+    TraceScope grey("grey");
+    if (_img.channels() == 1) {
+        _imgGray = _img;
+        if (_debugWindow) {
+            // colored debug drawings
+#if CV_MAJOR_VERSION == 2
+            cvtColor(_imgGray, _img, CV_GRAY2BGR);
+#elif CV_MAJOR_VERSION == 3 | 4
+            cvtColor(_imgGray, _img, cv::COLOR_GRAY2BGR);
+#endif
+        }
+    } else {
 #if CV_MAJOR_VERSION == 2
-    cvtColor(_img, _imgGray, CV_BGR2GRAY);
+        cvtColor(_img, _imgGray, CV_BGR2GRAY);
 #elif CV_MAJOR_VERSION == 3 | 4
-    cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
+        cvtColor(_img, _imgGray, cv::COLOR_BGR2GRAY);
 #endif
+    }
+    grey.end();
 
     // initial rotation to get the digits up
     rotate(_config.getRotationDegrees());
@@ -102,6 +154,7 @@ void ImageProcessor::process() {
  * Rotate image.
  */
 void ImageProcessor::rotate(double rotationDegrees) {
+    TraceScope trace("rotate");
     cv::Mat M = cv::getRotationMatrix2D(cv::Point(_imgGray.cols / 2, _imgGray.rows / 2), rotationDegrees, 1);
     cv::Mat img_rotated;
     cv::warpAffine(_imgGray, img_rotated, M, _imgGray.size());
@@ -144,7 +197,7 @@ void ImageProcessor::drawLines(std::vector<cv::Vec4i> & lines, int xoff, int yof
  * Detect the skew of the image by finding almost (+- 30 deg) horizontal lines.
  */
 float ImageProcessor::detectSkew() {
-    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    StageTimer timer(STAGE_SKEW);
 
     cv::Mat edges = cannyEdges();
 
@@ -168,9 +221,9 @@ float ImageProcessor::detectSkew() {
     if (filteredLines.size() > 0) {
         theta_avr /= filteredLines.size();
         theta_deg = (theta_avr / CV_PI * 180.f) - 90;
-        rlog.info("detectSkew: %.1f deg", theta_deg);
+        LOG_INFO("detectSkew: %.1f deg", theta_deg);
     } else {
-        rlog.warn("failed to detect skew");
+        LOG_WARN("failed to detect skew");
     }
 
     if (_debugSkew) {
@@ -184,6 +237,7 @@ float ImageProcessor::detectSkew() {
  * Detect edges using Canny algorithm.
  */
 cv::Mat ImageProcessor::cannyEdges() {
+    TraceScope trace("canny");
     cv::Mat edges;
     // detect edges
     //cv::imshow("Grey", _imgGray);
@@ -222,16 +276,13 @@ int FindBound(std::vector<cv::Rect> & boundingBoxes, cv::Rect bound) {
 }
 
 /**
- * Filter contours by size of bounding rectangle.
+ * Filter bounding rectangles of the candidates by size, keep the larger of
+ * overlapping ones. kept receives the candidate index of each bounding box.
  */
-void ImageProcessor::filterContours(std::vector<std::vector<cv::Point> > & contours,
-                                    std::vector<cv::Rect> & boundingBoxes,
-                                    std::vector<std::vector<cv::Point> > & filteredContours) {
-
-    // filter contours by bounding rect size
-
-    for (size_t i = 0; i < contours.size(); i++) {
-        cv::Rect bounds = cv::boundingRect(contours[i]);
+void ImageProcessor::filterBoxes(const std::vector<cv::Rect> & candidates, std::vector<cv::Rect> & boundingBoxes,
+                                 std::vector<int> & kept) {
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const cv::Rect & bounds = candidates[i];
         if (bounds.height > _config.getDigitMinHeight() && bounds.height < _config.getDigitMaxHeight()
                 && bounds.width > 10 && bounds.width < bounds.height) {
             int position = FindBound(boundingBoxes, bounds);
@@ -239,15 +290,14 @@ void ImageProcessor::filterContours(std::vector<std::vector<cv::Point> > & conto
             case -2:
                 break;
             case -1:
-                ;
                 boundingBoxes.push_back(bounds);
-                filteredContours.push_back(contours[i]);
+                kept.push_back(i);
                 break;
             default:
                 boundingBoxes.erase(boundingBoxes.begin() + position);
-                filteredContours.erase(filteredContours.begin() + position);
+                kept.erase(kept.begin() + position);
                 boundingBoxes.push_back(bounds);
-                filteredContours.push_back(contours[i]);
+                kept.push_back(i);
                 break;
             }
         }
@@ -255,40 +305,119 @@ void ImageProcessor::filterContours(std::vector<std::vector<cv::Point> > & conto
 }
 
 /**
- * Find and isolate the digits of the counter,
+ * Bounding boxes of the 8-connected edge components, the same boxes as of
+ * the outer contours without storing a point per edge pixel.
  */
-void ImageProcessor::findCounterDigits() {
-    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+void ImageProcessor::findComponentBoxes(const cv::Mat & edges, std::vector<cv::Rect> & boundingBoxes) {
+#if CV_MAJOR_VERSION == 2
+    // no connectedComponentsWithStats before OpenCV 3
+    cv::Mat copy = edges.clone();
+    findContourBoxes(copy, boundingBoxes);
+#elif CV_MAJOR_VERSION == 3 | 4
+    TraceScope traceComponents("contours");
+    int n = cv::connectedComponentsWithStats(edges, _labels, _stats, _centroids, 8, CV_32S);
+    // label 0 is the background
+    _candidates.clear();
+    for (int label = 1; label < n; ++label) {
+        const int * stat = _stats.ptr<int>(label);
+        _candidates.push_back(cv::Rect(stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP],
+                                       stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]));
+    }
+    Metrics::get().count(COUNTER_CONTOURS, _candidates.size());
+    traceComponents.arg("contours", _candidates.size());
+    traceComponents.end();
+    LOG_INFO("number of found components: %d", (int) _candidates.size());
+
+    TraceScope traceFilter("filter");
+    _kept.clear();
+    filterBoxes(_candidates, boundingBoxes, _kept);
+    traceFilter.arg("boxes", boundingBoxes.size());
+    traceFilter.end();
+    LOG_INFO("number of boundingBoxes: %d", (int) boundingBoxes.size());
 
-    // edge image
-    cv::Mat edges = cannyEdges();
     if (_debugEdges) {
-        cv::imshow("edges", edges);
+        // edge pixels of the kept components
+        std::vector<uchar> keep(n, 0);
+        for (size_t i = 0; i < _kept.size(); ++i) {
+            keep[_kept[i] + 1] = 255;
+        }
+        cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
+        for (int y = 0; y < cont.rows; ++y) {
+            const int * label = _labels.ptr<int>(y);
+            uchar * p = cont.ptr<uchar>(y);
+            for (int x = 0; x < cont.cols; ++x) {
+                p[x] = keep[label[x]];
+            }
+        }
+        cv::imshow("contours", cont);
     }
+#endif
+}
 
-    cv::Mat img_ret = edges.clone();
-
-    // find contours in whole image
-    std::vector<std::vector<cv::Point> > contours, filteredContours;
-    std::vector<cv::Rect> boundingBoxes;
+/**
+ * Bounding boxes of all contours including holes, modifies edges before
+ * OpenCV 3.2.
+ */
+void ImageProcessor::findContourBoxes(cv::Mat & edges, std::vector<cv::Rect> & boundingBoxes) {
+    std::vector<std::vector<cv::Point> > contours;
+    TraceScope traceContours("contours");
 
 #if CV_MAJOR_VERSION == 2
     cv::findContours(edges, contours, CV_RETR_CCOMP, CV_CHAIN_APPROX_NONE);
 #elif CV_MAJOR_VERSION == 3 | 4
     cv::findContours(edges, contours, cv::RETR_CCOMP, cv::CHAIN_APPROX_NONE);
 #endif
+    Metrics::get().count(COUNTER_CONTOURS, contours.size());
+    traceContours.arg("contours", contours.size());
+    traceContours.end();
+    LOG_INFO("number of found contours: %d", (int) contours.size());
 
-    // filter contours by bounding rect size
+    TraceScope traceFilter("filter");
+    _candidates.clear();
+    for (size_t i = 0; i < contours.size(); i++) {
+        _candidates.push_back(cv::boundingRect(contours[i]));
+    }
+    _kept.clear();
+    filterBoxes(_candidates, boundingBoxes, _kept);
+    traceFilter.arg("boxes", boundingBoxes.size());
+    traceFilter.end();
+    LOG_INFO("number of boundingBoxes: %d", (int) boundingBoxes.size());
 
-    rlog << log4cpp::Priority::INFO << "number of founded contours: " << contours.size();
-    rlog << log4cpp::Priority::INFO << "number of boundingBoxex: " << boundingBoxes.size();
+    if (_debugEdges) {
+        std::vector<std::vector<cv::Point> > filteredContours;
+        for (size_t i = 0; i < _kept.size(); ++i) {
+            filteredContours.push_back(contours[_kept[i]]);
+        }
+        cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
+        cv::drawContours(cont, filteredContours, -1, cv::Scalar(255));
+        cv::imshow("contours", cont);
+    }
+}
 
-    filterContours(contours, boundingBoxes, filteredContours);
+/**
+ * Find and isolate the digits of the counter,
+ */
+void ImageProcessor::findCounterDigits() {
+    StageTimer timer(STAGE_DIGITS);
 
-    rlog << log4cpp::Priority::INFO << "number of filtered contours: " << filteredContours.size();
-    rlog << log4cpp::Priority::INFO << "number of boundingBoxex: " << boundingBoxes.size();
+    // edge image
+    cv::Mat edges = cannyEdges();
+    if (_debugEdges) {
+        cv::imshow("edges", edges);
+    }
+
+    // bounding boxes of the edge components, filtered by size
+    std::vector<cv::Rect> boundingBoxes;
+    if (_config.getSegmentation() == "components") {
+        findComponentBoxes(edges, boundingBoxes);
+    } else {
+        // findContours may modify its input
+        cv::Mat img = edges.clone();
+        findContourBoxes(img, boundingBoxes);
+    }
 
     // find bounding boxes that are aligned at y position
+    TraceScope traceAlign("align");
     std::vector<cv::Rect> alignedBoundingBoxes, tmpRes;
     for (std::vector<cv::Rect>::const_iterator ib = boundingBoxes.begin(); ib != boundingBoxes.end(); ++ib) {
         tmpRes.clear();
@@ -297,22 +426,17 @@ void ImageProcessor::findCounterDigits() {
             alignedBoundingBoxes = tmpRes;
         }
     }
-    rlog << log4cpp::Priority::INFO << "max number of alignedBoxes: " << alignedBoundingBoxes.size();
+    LOG_INFO("max number of alignedBoxes: %d", (int) alignedBoundingBoxes.size());
 
     // sort bounding boxes from left to right
     std::sort(alignedBoundingBoxes.begin(), alignedBoundingBoxes.end(), sortRectByX());
-
-    if (_debugEdges) {
-        // draw contours
-        cv::Mat cont = cv::Mat::zeros(edges.rows, edges.cols, CV_8UC1);
-        cv::drawContours(cont, filteredContours, -1, cv::Scalar(255));
-        cv::imshow("contours", cont);
-    }
+    traceAlign.arg("digits", alignedBoundingBoxes.size());
+    traceAlign.end();
 
     // cut out found rectangles from edged image
     for (size_t i = 0; i < alignedBoundingBoxes.size(); ++i) {
         cv::Rect roi = alignedBoundingBoxes[i];
-        _digits.push_back(img_ret(roi));
+        _digits.push_back(edges(roi));
         _rois.push_back(roi);
         if (_debugDigits) {
             cv::putText(_img, std::to_string(i), cv::Point(roi.x + roi.width / 2, roi.y + roi.height / 2), CV_FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, i * 30));
@@ -12,13 +12,17 @@
 
 #include "ImageInput.h"
 #include "Config.h"
+#include "FrameQuality.h"
 
 class ImageProcessor {
 public:
     ImageProcessor(const Config & config);
 
+    void setConfig(const Config & config);
+
     void setOrientation(int rotationDegrees);
     void setInput(cv::Mat & img);
+    bool checkQuality();
     void process();
     const std::vector<cv::Mat> & getOutput();
 
@@ -39,14 +43,23 @@ private:
     void drawLines(std::vector<cv::Vec2f> & lines);
     void drawLines(std::vector<cv::Vec4i> & lines, int xoff = 0, int yoff = 0);
     cv::Mat cannyEdges();
-    void filterContours(std::vector<std::vector<cv::Point> > & contours, std::vector<cv::Rect> & boundingBoxes,
-                        std::vector<std::vector<cv::Point> > & filteredContours);
+    void findComponentBoxes(const cv::Mat & edges, std::vector<cv::Rect> & boundingBoxes);
+    void findContourBoxes(cv::Mat & edges, std::vector<cv::Rect> & boundingBoxes);
+    void filterBoxes(const std::vector<cv::Rect> & candidates, std::vector<cv::Rect> & boundingBoxes,
+                     std::vector<int> & kept);
 
     cv::Mat _img;
     cv::Mat _imgGray;
     std::vector<cv::Mat> _digits;
     std::vector<cv::Rect> _rois;
+    // buffers of the connected components, reused between frames
+    cv::Mat _labels;
+    cv::Mat _stats;
+    cv::Mat _centroids;
+    std::vector<cv::Rect> _candidates;
+    std::vector<int> _kept;
     Config _config;
+    FrameQuality _quality;
     bool _debugWindow;
     bool _debugSkew;
     bool _debugEdges;
@@ -14,21 +14,33 @@
 #include <log4cpp/Priority.hh>
 
 #include <exception>
+#include <future>
+#include <chrono>
+#include <utility>
+#include <algorithm>
 
 #include "KNearestOcr.h"
+#include "Log.h"
+#include "Metrics.h"
 
 KNearestOcr::KNearestOcr(const Config & config) :
 #if CV_MAJOR_VERSION == 2
     _pModel(0),
+    _ownsModel(true),
 #elif CV_MAJOR_VERSION == 3 | 4
     _pModel(),
 #endif
-    _config(config) {
+    _config(config),
+    _wantedFile(config.getTrainingDataFilename()),
+    _reloadPending(false) {
 }
 
 KNearestOcr::~KNearestOcr() {
+    if (_loading.valid()) {
+        delete _loading.get();
+    }
 #if CV_MAJOR_VERSION == 2
-    if (_pModel) {
+    if (_pModel && _ownsModel) {
         delete _pModel;
     }
 #endif
@@ -91,11 +103,110 @@ bool KNearestOcr::loadTrainingData() {
     return true;
 }
 
+/**
+ * Take over a reloaded config. If the training file changed, the new model
+ * is loaded in the background and swapped in by swapModel(). The config keeps
+ * the training file of the model in use until then, so a failed load is
+ * retried with the next reload.
+ */
+void KNearestOcr::setConfig(const Config & config) {
+    std::string current = _config.getTrainingDataFilename();
+    _wantedFile = config.getTrainingDataFilename();
+    _config = config;
+    _config.setTrainingDataFilename(current);
+    // a running load is collected by swapModel, which starts the next one
+    if (_wantedFile != current && _loadingFile.empty()) {
+        startLoading(_wantedFile);
+    }
+}
+
+/**
+ * The training file was written again, e.g. by -l: load it in the background
+ * like a new one.
+ */
+void KNearestOcr::reloadTrainingData() {
+    if (_loadingFile.empty()) {
+        startLoading(_wantedFile);
+    } else {
+        // the running load may have read the file before it was written
+        _reloadPending = true;
+    }
+}
+
+void KNearestOcr::startLoading(const std::string & filename) {
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Loading training data " << filename;
+    Config config(_config);
+    config.setTrainingDataFilename(filename);
+    _loadingFile = filename;
+    _loading = std::async(std::launch::async, [config]() {
+        KNearestOcr * ocr = new KNearestOcr(config);
+        if (!ocr->loadTrainingData()) {
+            delete ocr;
+            ocr = 0;
+        }
+        return ocr;
+    });
+}
+
+/**
+ * Use the model loaded in the background once it is ready,
+ * called between two images.
+ */
+bool KNearestOcr::swapModel() {
+    if (!_loading.valid() || _loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    KNearestOcr * ocr = _loading.get();
+    std::string filename = _loadingFile;
+    _loadingFile.clear();
+    bool reload = _reloadPending;
+    _reloadPending = false;
+    if (filename != _wantedFile || reload) {
+        // the config or the training file changed again while loading
+        delete ocr;
+        if (reload || _wantedFile != _config.getTrainingDataFilename()) {
+            startLoading(_wantedFile);
+        }
+        return false;
+    }
+    if (!ocr) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't load training data "
+                << filename << ", keeping the previous model";
+        return false;
+    }
+    std::swap(_samples, ocr->_samples);
+    std::swap(_responses, ocr->_responses);
+    std::swap(_pModel, ocr->_pModel);
+#if CV_MAJOR_VERSION == 2
+    std::swap(_ownsModel, ocr->_ownsModel);
+#endif
+    delete ocr;
+    _config.setTrainingDataFilename(filename);
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Swapped in training data " << filename;
+    return true;
+}
+
+/**
+ * Use the model of other, which must outlive this object, instead of
+ * loading the training data again. Recognition only reads the model, so
+ * several threads can use it at the same time.
+ */
+void KNearestOcr::shareModel(const KNearestOcr & other) {
+#if CV_MAJOR_VERSION == 2
+    if (_pModel && _ownsModel) {
+        delete _pModel;
+    }
+    _ownsModel = false;
+#endif
+    _samples = other._samples;
+    _responses = other._responses;
+    _pModel = other._pModel;
+}
+
 /**
  * Recognize a single digit.
  */
 char KNearestOcr::recognize(const cv::Mat& img) {
-    log4cpp::Category& rlog = log4cpp::Category::getRoot();
     char cres = '?';
     try {
 #if CV_MAJOR_VERSION == 2
@@ -115,14 +226,14 @@ char KNearestOcr::recognize(const cv::Mat& img) {
                 && dists.at<float>(0, 0) < _config.getOcrMaxDist()) {
             // valid character if both neighbors have the same value and distance is below ocrMaxDist
             cres = '0' + (int) result;
-        } else if (rlog.isInfoEnabled()) {
-            rlog << log4cpp::Priority::INFO << "OCR rejected: " << (int) result;
+        } else {
+            LOG_INFO("OCR rejected: %d", (int) result);
         }
-        rlog << log4cpp::Priority::DEBUG << "results: " << results;
-        rlog << log4cpp::Priority::DEBUG << "neighborResponses: " << neighborResponses;
-        rlog << log4cpp::Priority::DEBUG << "dists: " << dists;
+        LOG_DEBUG("results: %.0f neighborResponses: %.0f %.0f dists: %.0f %.0f", results.at<float>(0, 0),
+                  neighborResponses.at<float>(0, 0), neighborResponses.at<float>(0, 1),
+                  dists.at<float>(0, 0), dists.at<float>(0, 1));
     } catch (std::exception & e) {
-        rlog << log4cpp::Priority::ERROR << e.what();
+        LOG_ERROR("%s", e.what());
     }
     return cres;
 }
@@ -131,11 +242,15 @@ char KNearestOcr::recognize(const cv::Mat& img) {
  * Recognize a vector of digits.
  */
 std::string KNearestOcr::recognize(const std::vector<cv::Mat>& images) {
+    StageTimer timer(STAGE_OCR);
     std::string result;
     for (std::vector<cv::Mat>::const_iterator it = images.begin();
             it != images.end(); ++it) {
         result += recognize(*it);
     }
+    int unrecognized = std::count(result.begin(), result.end(), '?');
+    Metrics::get().count(COUNTER_UNRECOGNIZED, unrecognized);
+    timer.arg("unrecognized", unrecognized);
     return result;
 }
 
@@ -154,7 +269,11 @@ cv::Mat KNearestOcr::prepareSample(const cv::Mat& img) {
  */
 void KNearestOcr::initModel() {
 #if CV_MAJOR_VERSION == 2
+    if (_pModel && _ownsModel) {
+        delete _pModel;
+    }
     _pModel = new CvKNearest(_samples, _responses);
+    _ownsModel = true;
 #elif CV_MAJOR_VERSION == 3 | 4
     _pModel = cv::ml::KNearest::create();
     // load persistent model
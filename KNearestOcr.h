@@ -9,6 +9,7 @@
 #include <vector>
 #include <list>
 #include <string>
+#include <future>
 #include "opencv2/core/version.hpp"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/ml/ml.hpp>
@@ -25,6 +26,10 @@ public:
     bool hasTrainingData();
     void saveTrainingData();
     bool loadTrainingData();
+    void setConfig(const Config & config);
+    void reloadTrainingData();
+    bool swapModel();
+    void shareModel(const KNearestOcr & other);
 
     char recognize(const cv::Mat & img);
     std::string recognize(const std::vector<cv::Mat> & images);
@@ -32,15 +37,25 @@ public:
 private:
     cv::Mat prepareSample(const cv::Mat & img);
     void initModel();
+    void startLoading(const std::string & filename);
 
     cv::Mat _samples;
     cv::Mat _responses;
 #if CV_MAJOR_VERSION == 2
     CvKNearest* _pModel;
+    bool _ownsModel;
 #elif CV_MAJOR_VERSION == 3 | 4
     cv::Ptr<cv::ml::KNearest> _pModel;
 #endif
     Config _config;
+    // model loaded in the background after the training file changed
+    std::future<KNearestOcr *> _loading;
+    // training file of _loading, empty if none
+    std::string _loadingFile;
+    // training file of the latest config
+    std::string _wantedFile;
+    // the training file was written while _loading read it
+    bool _reloadPending;
 };
 
 #endif /* KNEARESTOCR_H_ */
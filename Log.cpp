@@ -0,0 +1,143 @@
+/*
+ * Log.cpp
+ *
+ */
+
+#include <string>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/LoggingEvent.hh>
+#include <log4cpp/TimeStamp.hh>
+
+#include "Log.h"
+
+/**
+ * Slot of the ring. seq == index: free for the producer of that index,
+ * seq == index + 1: message ready for the consumer.
+ */
+struct LogSlot {
+    std::atomic<size_t> seq;
+    int priority;
+    int64_t time;
+    char message[AsyncLog::MESSAGE_SIZE];
+};
+
+static LogSlot slots[AsyncLog::SLOTS];
+static std::atomic<size_t> tail(0);
+static size_t head = 0;
+
+std::atomic<int> AsyncLog::_priority(log4cpp::Priority::INFO);
+std::atomic<bool> AsyncLog::_running(false);
+std::atomic<uint64_t> AsyncLog::_dropped(0);
+std::thread AsyncLog::_thread;
+
+static int64_t wallMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void AsyncLog::start() {
+    _priority = log4cpp::Category::getRoot().getPriority();
+    if (_running.exchange(true)) {
+        return;
+    }
+    for (size_t i = 0; i < SLOTS; ++i) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    tail = 0;
+    head = 0;
+    _thread = std::thread(&AsyncLog::run);
+    static bool registered = false;
+    if (!registered) {
+        // also flush on exit() of error paths
+        atexit(&AsyncLog::stop);
+        registered = true;
+    }
+}
+
+void AsyncLog::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    _thread.join();
+    flush();
+}
+
+void AsyncLog::write(int priority, const char * fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    if (!_running.load(std::memory_order_acquire)) {
+        char message[MESSAGE_SIZE];
+        vsnprintf(message, sizeof(message), fmt, args);
+        va_end(args);
+        log4cpp::Category::getRoot().log(priority, std::string(message));
+        return;
+    }
+    size_t pos = tail.load(std::memory_order_relaxed);
+    LogSlot * slot;
+    for (;;) {
+        slot = &slots[pos % SLOTS];
+        intptr_t diff = (intptr_t) slot->seq.load(std::memory_order_acquire) - (intptr_t) pos;
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the background thread is behind a whole ring
+            va_end(args);
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->priority = priority;
+    slot->time = wallMicros();
+    vsnprintf(slot->message, MESSAGE_SIZE, fmt, args);
+    va_end(args);
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * Pass the ready messages to the appenders with the time they were logged.
+ * Returns false if there were none.
+ */
+bool AsyncLog::flush() {
+    log4cpp::Category & root = log4cpp::Category::getRoot();
+    bool written = false;
+    for (;;) {
+        LogSlot & slot = slots[head % SLOTS];
+        if (slot.seq.load(std::memory_order_acquire) != head + 1) {
+            break;
+        }
+        log4cpp::LoggingEvent event(root.getName(), slot.message, "", slot.priority);
+        event.timeStamp = log4cpp::TimeStamp(slot.time / 1000000, slot.time % 1000000);
+        slot.seq.store(head + SLOTS, std::memory_order_release);
+        ++head;
+        root.callAppenders(event);
+        written = true;
+    }
+    return written;
+}
+
+void AsyncLog::run() {
+    uint64_t reported = 0;
+    while (_running.load(std::memory_order_acquire)) {
+        bool written = flush();
+        uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Log queue full, dropped "
+                                         << (dropped - reported) << " messages";
+            reported = dropped;
+        }
+        if (!written) {
+            usleep(20000);
+        }
+    }
+}
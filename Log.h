@@ -0,0 +1,95 @@
+/*
+ * Log.h
+ *
+ * Logging for the per frame paths. Statements below LOG_LEVEL are removed
+ * by the preprocessor, their arguments are not even evaluated. Enabled
+ * statements format the message into a slot of a lock free ring buffer,
+ * a background thread hands it to the log4cpp appenders. A full ring
+ * drops the message instead of blocking the frame.
+ *
+ * LOG_LEVEL defaults to LOG_LEVEL_DEBUG in debug builds and to
+ * LOG_LEVEL_INFO otherwise, e.g. make RELEASE=true LOG_LEVEL=LOG_LEVEL_WARN.
+ *
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include <log4cpp/Priority.hh>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_LEVEL
+#ifdef _DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_AT(priority, ...) \
+    do { \
+        if (AsyncLog::enabled(priority)) { \
+            AsyncLog::write(priority, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(log4cpp::Priority::DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(log4cpp::Priority::INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(log4cpp::Priority::WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { } while (0)
+#endif
+
+#define LOG_ERROR(...) LOG_AT(log4cpp::Priority::ERROR, __VA_ARGS__)
+
+class AsyncLog {
+public:
+    enum { SLOTS = 1024, MESSAGE_SIZE = 240 };
+
+    // takes the priority of the log4cpp root category, call after configuring it.
+    // The queue is written at exit() or by stop().
+    static void start();
+    // write the queued messages and stop the thread
+    static void stop();
+
+    static bool enabled(int priority) {
+        return priority <= _priority.load(std::memory_order_relaxed);
+    }
+
+    // printf style, synchronous before start()
+    static void write(int priority, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    static uint64_t dropped() {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void run();
+    static bool flush();
+
+    static std::atomic<int> _priority;
+    static std::atomic<bool> _running;
+    static std::atomic<uint64_t> _dropped;
+    static std::thread _thread;
+};
+
+#endif /* LOG_H_ */
@@ -0,0 +1,254 @@
+/*
+ * Meter.cpp
+ *
+ */
+
+#include <string>
+#include <cstdlib>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Directory.h"
+#include "Log.h"
+#include "Meter.h"
+#include "Trace.h"
+
+Meter::Meter(const std::string & name, const std::string & topic, const Config & config, ImageInput * input,
+             int delay, bool replay) :
+    _name(name), _topic(topic), _config(config), _input(input),
+    // inotify: the camera is another program, see writeData
+    _scheduler(delay, replay || dynamic_cast<InotifyInput *>(input) ? 0 : config.getScheduleMaxDelay(),
+               config.getScheduleCpuBudget(), MeterLayout(config.getMeterDigits(), config.getMeterDecimals())),
+    _proc(config),
+    _plausi(config.getPlausiMaxPower(), config.getPlausiWindow(), config.getPlausiMedian(),
+            config.getPlausiReconcile(), MeterLayout(config.getMeterDigits(), config.getMeterDecimals())),
+    _ocr(config),
+    _outputs(config.getSinkQueueSize(), replay),
+    _pool(0), _stop(0), _replay(replay) {
+    _plausi.setStateFile(config.getPlausiStateFile(), config.getPlausiStateMaxAge());
+}
+
+Meter::~Meter() {
+    join();
+    delete _input;
+}
+
+/**
+ * Share the OCR model with meters of the same training file and create the sinks.
+ */
+bool Meter::init(std::map<std::string, std::shared_ptr<KNearestOcr> > & models, const std::string & hostname,
+                 std::shared_ptr<MqttConnection> & connection) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    std::string trainingFile = _config.getTrainingDataFilename();
+    std::shared_ptr<KNearestOcr> & model = models[trainingFile];
+    if (!model) {
+        std::shared_ptr<KNearestOcr> loaded = std::make_shared<KNearestOcr>(_config);
+        if (!loaded->loadTrainingData()) {
+            rlog << log4cpp::Priority::ERROR << "Meter " << _name << ": can't load training data " << trainingFile;
+            models.erase(trainingFile);
+            return false;
+        }
+        rlog << log4cpp::Priority::INFO << "OCR training data loaded from " << trainingFile;
+        model = loaded;
+    }
+    _ocr.shareModel(*model);
+
+    createSinks(_outputs, sinks(), _config, hostname, _topic, connection, _replay);
+    return true;
+}
+
+std::string Meter::sinks() const {
+    return _config.getSinks().empty() ? "mqtt" : _config.getSinks();
+}
+
+void Meter::start(ThreadPool & pool, const volatile bool & stop) {
+    _pool = &pool;
+    _stop = &stop;
+    _input->setStop(&stop);
+    _thread = std::thread(&Meter::run, this);
+}
+
+void Meter::join() {
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+/**
+ * Wait for images in a thread of the meter, process them on the pool.
+ * The next image is read when the previous one is done.
+ */
+void Meter::run() {
+    Trace::setThreadName("meter " + _name);
+    std::string path;
+    while (!*_stop && _input->nextImage(path)) {
+        uint64_t frame = Trace::currentFrame();
+        _pool->submit([this, frame]() {
+            Trace::setFrame(frame);
+            process();
+        }).wait();
+        Trace::dumpIfRequested();
+        _scheduler.sleep(*_stop);
+    }
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Meter " << _name << " stopped";
+}
+
+void Meter::process() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    _proc.setInput(_input->getImage());
+    if (!_proc.checkQuality()) {
+        return;
+    }
+    _proc.process();
+
+    Reading reading;
+    reading.time = _input->getTime();
+    reading.ocr = _ocr.recognize(_proc.getOutput());
+    reading.checked = _plausi.check(reading.ocr, reading.time);
+    reading.value = _plausi.getCheckedValue();
+    reading.checkedTime = _plausi.getCheckedTime();
+    reading.frame = Trace::currentFrame();
+    LOG_INFO("Meter %s: %s", _name.c_str(), reading.ocr.c_str());
+    _outputs.publish(reading);
+    _scheduler.update(reading, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+MeterSet::MeterSet(const Config & config, const std::string & hostname) :
+    _config(config), _hostname(hostname) {
+}
+
+/**
+ * Stop the meters before the shared models and connection are released.
+ */
+MeterSet::~MeterSet() {
+    for (size_t i = 0; i < _meters.size(); ++i) {
+        delete _meters[i];
+    }
+}
+
+/**
+ * Image input of a meter: dir:, inotify:, camera:, shm:, archive: or synthetic:
+ * followed by the directory, camera number, shared memory name, archive path
+ * or style file.
+ */
+ImageInput * MeterSet::createInput(const std::string & spec) {
+    size_t colon = spec.find(':');
+    std::string type = spec.substr(0, colon);
+    std::string arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    if (type == "dir") {
+        return new DirectoryInput(Directory(arg.c_str(), ".png"));
+    } else if (type == "inotify") {
+        return new InotifyInput(arg, 1000);
+    } else if (type == "camera") {
+        return new CameraInput(atoi(arg.c_str()));
+    } else if (type == "shm") {
+        return new ShmInput(arg, 1000);
+    } else if (type == "archive") {
+        return new ArchiveInput(arg);
+    } else if (type == "synthetic") {
+        MeterStyle style;
+        return style.load(arg) ? new SyntheticInput(style, 0) : 0;
+    }
+    return 0;
+}
+
+/**
+ * Claim a state, spool or rrd file for meter, false if another meter writes it already.
+ */
+static bool claimFile(std::map<std::string, std::string> & files, const std::string & file, const std::string & meter) {
+    if (file.empty()) {
+        return true;
+    }
+    std::map<std::string, std::string>::const_iterator it = files.find(file);
+    if (it != files.end()) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Meters " << it->second << " and " << meter
+                                     << " both write " << file;
+        return false;
+    }
+    files[file] = meter;
+    return true;
+}
+
+/**
+ * Read the list of meters:
+ *
+ * meters:
+ *   - { name: gas, config: gas.yml, input: "inotify:/var/cam/gas" }
+ *   - { name: water, config: water.yml, input: "shm:/water", topic: water_reco, delay: 500 }
+ *
+ * config defaults to <name>.yml, topic to the name and delay (ms) to -s.
+ * State, spool and rrd files with their default names get the name as prefix,
+ * meters that would still write the same file are refused.
+ */
+bool MeterSet::load(const std::string & path, int delay) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        rlog << log4cpp::Priority::ERROR << "Can't read meters " << path;
+        return false;
+    }
+    cv::FileNode meters = fs["meters"];
+    // file -> meter writing it
+    std::map<std::string, std::string> files;
+    for (cv::FileNodeIterator it = meters.begin(); it != meters.end(); ++it) {
+        cv::FileNode node = *it;
+        std::string name = (std::string) node["name"];
+        std::string configPath = node["config"].empty() ? name + ".yml" : (std::string) node["config"];
+        std::string topic = node["topic"].empty() ? name : (std::string) node["topic"];
+        int meterDelay = node["delay"].empty() ? delay : (int) node["delay"];
+
+        ImageInput * input = createInput((std::string) node["input"]);
+        if (name.empty() || !input) {
+            rlog << log4cpp::Priority::ERROR << "Meter " << name << ": name and input (dir:, inotify:, camera:, shm:, archive:, synthetic:) required";
+            delete input;
+            return false;
+        }
+        Config config;
+        config.loadConfig(configPath);
+        config.setMeterName(name);
+        InotifyInput * inotifyInput = dynamic_cast<InotifyInput *>(input);
+        if (inotifyInput) {
+            inotifyInput->setStateFile(config.getInotifyStateFile());
+        }
+
+        bool replay = dynamic_cast<DirectoryInput *>(input) || dynamic_cast<ArchiveInput *>(input)
+                      || dynamic_cast<SyntheticInput *>(input);
+        Meter * meter = new Meter(name, topic, config, input, meterDelay, replay);
+        _meters.push_back(meter);
+        if (!claimFile(files, config.getPlausiStateFile(), name)
+                || (inotifyInput && !claimFile(files, config.getInotifyStateFile(), name))
+                || (usesSink(meter->sinks(), "mqtt") && !claimFile(files, config.getMqttSpoolFile(), name))
+                || (usesSink(meter->sinks(), "rrd") && !claimFile(files, config.getRrdFile(), name))) {
+            return false;
+        }
+        if (!_connection && usesMqtt(meter->sinks())) {
+            // the broker of the main config, not of the first meter
+            _connection = std::make_shared<MqttConnection>(_hostname, _config);
+        }
+        if (!meter->init(_models, _hostname, _connection)) {
+            return false;
+        }
+    }
+    fs.release();
+    rlog << log4cpp::Priority::INFO << _meters.size() << " meters, " << _models.size() << " OCR models";
+    return !_meters.empty();
+}
+
+/**
+ * Run all meters until stop is set or all inputs are at their end.
+ */
+void MeterSet::run(const volatile bool & stop) {
+    ThreadPool pool(_config.getMeterThreads());
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Processing " << _meters.size() << " meters with "
+                                 << pool.size() << " threads";
+    for (size_t i = 0; i < _meters.size(); ++i) {
+        _meters[i]->start(pool, stop);
+    }
+    for (size_t i = 0; i < _meters.size(); ++i) {
+        _meters[i]->join();
+    }
+}
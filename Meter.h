@@ -0,0 +1,87 @@
+/*
+ * Meter.h
+ *
+ * Several meters in one process (-M meters.yml). Each meter has its own
+ * input, config (geometry, Plausi limits, sinks) and MQTT topic. The image
+ * processing of all meters runs on one thread pool, meters with the same
+ * training file share the OCR model and all MQTT sinks share one broker
+ * connection.
+ *
+ */
+
+#ifndef METER_H_
+#define METER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "CaptureScheduler.h"
+#include "Config.h"
+#include "ImageInput.h"
+#include "ImageProcessor.h"
+#include "KNearestOcr.h"
+#include "Plausi.h"
+#include "Sink.h"
+#include "ThreadPool.h"
+
+class Meter {
+public:
+    // replay: the input holds images of the past, use the fixed delay
+    Meter(const std::string & name, const std::string & topic, const Config & config, ImageInput * input, int delay,
+          bool replay);
+    ~Meter();
+
+    bool init(std::map<std::string, std::shared_ptr<KNearestOcr> > & models, const std::string & hostname,
+              std::shared_ptr<MqttConnection> & connection);
+    void start(ThreadPool & pool, const volatile bool & stop);
+    void join();
+
+    const std::string & name() const {
+        return _name;
+    }
+
+    // comma separated sinks of the meter config
+    std::string sinks() const;
+
+private:
+    void run();
+    void process();
+
+    std::string _name;
+    std::string _topic;
+    Config _config;
+    ImageInput * _input;
+    CaptureScheduler _scheduler;
+    ImageProcessor _proc;
+    Plausi _plausi;
+    KNearestOcr _ocr;
+    SinkFanout _outputs;
+    ThreadPool * _pool;
+    const volatile bool * _stop;
+    bool _replay;
+    std::thread _thread;
+};
+
+class MeterSet {
+public:
+    MeterSet(const Config & config, const std::string & hostname);
+    ~MeterSet();
+
+    bool load(const std::string & path, int delay);
+    void run(const volatile bool & stop);
+
+private:
+    ImageInput * createInput(const std::string & spec);
+
+    Config _config;
+    std::string _hostname;
+    // OCR models by training file
+    std::map<std::string, std::shared_ptr<KNearestOcr> > _models;
+    std::shared_ptr<MqttConnection> _connection;
+    std::vector<Meter *> _meters;
+};
+
+#endif /* METER_H_ */
@@ -0,0 +1,71 @@
+/*
+ * MeterProfile.cpp
+ *
+ */
+
+#include <string>
+#include <cstdio>
+
+#include "MeterProfile.h"
+
+typedef bool (*ValueFunction)(const std::string & reading, double & result);
+
+template<int DIGITS>
+static ValueFunction valueFunction(int decimals) {
+    switch (decimals) {
+    case 0:
+        return &MeterProfile<DIGITS, 0>::value;
+    case 1:
+        return &MeterProfile<DIGITS, 1>::value;
+    case 2:
+        return &MeterProfile<DIGITS, 2>::value;
+    case 3:
+        return &MeterProfile<DIGITS, 3>::value;
+    }
+    return 0;
+}
+
+MeterLayout::MeterLayout(int digits, int decimals) :
+    _digits(digits), _decimals(decimals), _scale(1), _value(0) {
+    for (int i = 0; i < decimals; ++i) {
+        _scale *= 10;
+    }
+    switch (digits) {
+    case 4:
+        _value = valueFunction<4>(decimals);
+        break;
+    case 5:
+        _value = valueFunction<5>(decimals);
+        break;
+    case 6:
+        _value = valueFunction<6>(decimals);
+        break;
+    case 7:
+        _value = valueFunction<7>(decimals);
+        break;
+    case 8:
+        _value = valueFunction<8>(decimals);
+        break;
+    case 9:
+        _value = valueFunction<9>(decimals);
+        break;
+    }
+}
+
+bool MeterLayout::value(const std::string & reading, double & result) const {
+    if (_value) {
+        return _value(reading, result);
+    }
+    long long count;
+    if (_decimals < 0 || _decimals >= _digits || !readingCount(reading, _digits, _decimals, count)) {
+        return false;
+    }
+    result = (double) count / _scale;
+    return true;
+}
+
+std::string MeterLayout::format(long long count) const {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%0*lld", _digits, count);
+    return buf;
+}
@@ -0,0 +1,120 @@
+/*
+ * MeterProfile.h
+ *
+ * Number of digits and decimals of the counter. MeterProfile fixes them at
+ * compile time so the loops over the digits have constant bounds, MeterLayout
+ * picks the instantiation for the values of the config at runtime.
+ *
+ */
+
+#ifndef METERPROFILE_H_
+#define METERPROFILE_H_
+
+#include <string>
+
+/**
+ * Integer count of a reading, e.g. "00835995" -> 835995. All integer digits
+ * and up to all decimals must be present, missing decimals are read as 0.
+ * Returns false for other lengths and characters. MeterProfile::count is the
+ * same for a layout known at compile time.
+ */
+inline bool readingCount(const std::string & reading, int digits, int decimals, long long & count) {
+    const int integers = digits - decimals;
+    const int length = reading.length();
+    if (length < integers || length > digits) {
+        return false;
+    }
+    const char * p = reading.data();
+    count = 0;
+    for (int i = 0; i < digits; ++i) {
+        unsigned digit = i < length ? (unsigned) (p[i] - '0') : 0u;
+        if (digit > 9) {
+            return false;
+        }
+        count = count * 10 + digit;
+    }
+    return true;
+}
+
+template<int DIGITS, int DECIMALS>
+struct MeterProfile {
+    static_assert(DECIMALS >= 0 && DECIMALS < DIGITS && DIGITS <= 15, "unsupported meter profile");
+
+    enum {
+        digits = DIGITS,
+        decimals = DECIMALS
+    };
+
+    // 10^DECIMALS
+    static constexpr long long scale() {
+        return power10(DECIMALS);
+    }
+
+    // readingCount for this layout, the bounds of the loop are constants
+    static bool count(const std::string & reading, long long & count) {
+        const int length = reading.length();
+        if (length < DIGITS - DECIMALS || length > DIGITS) {
+            return false;
+        }
+        const char * p = reading.data();
+        count = 0;
+        for (int i = 0; i < DIGITS; ++i) {
+            unsigned digit = i < length ? (unsigned) (p[i] - '0') : 0u;
+            if (digit > 9) {
+                return false;
+            }
+            count = count * 10 + digit;
+        }
+        return true;
+    }
+
+    static bool value(const std::string & reading, double & result) {
+        long long n;
+        if (!count(reading, n)) {
+            return false;
+        }
+        result = (double) n / scale();
+        return true;
+    }
+
+private:
+    static constexpr long long power10(int n) {
+        return n == 0 ? 1 : 10 * power10(n - 1);
+    }
+};
+
+class MeterLayout {
+public:
+    // profiles with 4 to 9 digits and up to 3 decimals are compiled in
+    MeterLayout(int digits = 8, int decimals = 3);
+
+    int digits() const {
+        return _digits;
+    }
+
+    int decimals() const {
+        return _decimals;
+    }
+
+    // 10^decimals
+    long long scale() const {
+        return _scale;
+    }
+
+    // value of a reading, see readingCount
+    bool value(const std::string & reading, double & result) const;
+
+    // all digits of a count, e.g. 835995 -> "00835995"
+    std::string format(long long count) const;
+
+private:
+    typedef bool (*ValueFunction)(const std::string & reading, double & result);
+
+    int _digits;
+    int _decimals;
+    long long _scale;
+    // 0 for profiles that are not compiled in
+    ValueFunction _value;
+};
+
+#endif /* METERPROFILE_H_ */
@@ -0,0 +1,184 @@
+/*
+ * MeterRenderer.cpp
+ *
+ */
+
+#include <string>
+#include <cmath>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "MeterRenderer.h"
+
+MeterStyle::MeterStyle() :
+    width(640), height(480), digits(7), decimals(2), font("simplex"), thickness(3),
+    digitWidth(40), digitHeight(60), roll(true), background(110), drum(30), digit(230),
+    rotation(3.), skew(2.), blur(1.), noise(4.), glare(60.),
+    start(12345.67), step(0.004), interval(1000), seed(1) {
+}
+
+template<typename T>
+static void readOptional(const cv::FileStorage & fs, const char * name, T & value) {
+    cv::FileNode node = fs[name];
+    if (!node.empty()) {
+        node >> value;
+    }
+}
+
+bool MeterStyle::load(const std::string & path) {
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        return false;
+    }
+    int rollValue = roll;
+    int seedValue = seed;
+    readOptional(fs, "width", width);
+    readOptional(fs, "height", height);
+    readOptional(fs, "digits", digits);
+    readOptional(fs, "decimals", decimals);
+    readOptional(fs, "font", font);
+    readOptional(fs, "thickness", thickness);
+    readOptional(fs, "digitWidth", digitWidth);
+    readOptional(fs, "digitHeight", digitHeight);
+    readOptional(fs, "roll", rollValue);
+    readOptional(fs, "background", background);
+    readOptional(fs, "drum", drum);
+    readOptional(fs, "digit", digit);
+    readOptional(fs, "rotation", rotation);
+    readOptional(fs, "skew", skew);
+    readOptional(fs, "blur", blur);
+    readOptional(fs, "noise", noise);
+    readOptional(fs, "glare", glare);
+    readOptional(fs, "start", start);
+    readOptional(fs, "step", step);
+    readOptional(fs, "interval", interval);
+    readOptional(fs, "seed", seedValue);
+    roll = rollValue != 0;
+    seed = seedValue;
+    fs.release();
+    return true;
+}
+
+static int fontFace(const std::string & name) {
+    if (name == "plain") {
+        return cv::FONT_HERSHEY_PLAIN;
+    } else if (name == "duplex") {
+        return cv::FONT_HERSHEY_DUPLEX;
+    } else if (name == "complex") {
+        return cv::FONT_HERSHEY_COMPLEX;
+    } else if (name == "triplex") {
+        return cv::FONT_HERSHEY_TRIPLEX;
+    }
+    return cv::FONT_HERSHEY_SIMPLEX;
+}
+
+MeterRenderer::MeterRenderer(const MeterStyle & style, const Timestamp & start) :
+    _style(style), _font(fontFace(style.font)), _rng(style.seed), _value(style.start), _time(start),
+    _started(false) {
+    // digits fill 70% of the drum window
+    int baseline = 0;
+    cv::Size size = cv::getTextSize("0", _font, 1., _style.thickness, &baseline);
+    _scale = 0.7 * _style.digitHeight / size.height;
+}
+
+void MeterRenderer::next(cv::Mat & img) {
+    if (_started) {
+        _value += _style.step;
+        _time = Timestamp::fromMicros(_time.micros() + _style.interval * 1000LL);
+    }
+    _started = true;
+    render(_value, img);
+}
+
+/**
+ * Digit and the next one below, moved up by roll (0..1) of the window height.
+ */
+void MeterRenderer::drawDrum(cv::Mat & window, int digit, double roll) {
+    window.setTo(cv::Scalar::all(_style.drum));
+    int baseline = 0;
+    std::string text(1, '0' + digit);
+    std::string next(1, '0' + (digit + 1) % 10);
+    cv::Size size = cv::getTextSize(text, _font, _scale, _style.thickness, &baseline);
+    int x = (window.cols - size.width) / 2;
+    int y = (window.rows + size.height) / 2 - (int) (roll * window.rows);
+    // drawing is clipped to the window
+    cv::putText(window, text, cv::Point(x, y), _font, _scale, cv::Scalar::all(_style.digit), _style.thickness);
+    if (roll > 0.) {
+        cv::putText(window, next, cv::Point(x, y + window.rows), _font, _scale, cv::Scalar::all(_style.digit),
+                    _style.thickness);
+    }
+}
+
+void MeterRenderer::render(double value, cv::Mat & img) {
+    const MeterStyle & s = _style;
+    img.create(s.height, s.width, CV_8UC3);
+    img.setTo(cv::Scalar::all(s.background));
+
+    // counter with frame, unit and screws of the meter
+    int pitch = s.digitWidth + s.digitWidth / 5;
+    int counterWidth = s.digits * pitch - (pitch - s.digitWidth);
+    cv::Point origin((s.width - counterWidth) / 2, (s.height - s.digitHeight) / 2);
+    cv::rectangle(img, cv::Rect(origin.x - 12, origin.y - 12, counterWidth + 24, s.digitHeight + 24),
+                  cv::Scalar::all(s.drum / 2), -1);
+    cv::putText(img, "kWh", cv::Point(origin.x + counterWidth + 20, origin.y + s.digitHeight), _font, 0.8,
+                cv::Scalar::all(s.digit), 1);
+    cv::circle(img, cv::Point(30, 30), 8, cv::Scalar::all(s.drum), 2);
+    cv::circle(img, cv::Point(s.width - 30, s.height - 30), 8, cv::Scalar::all(s.drum), 2);
+
+    // drums from the right: a drum turns while all drums right of it show 9
+    double scaled = value * pow(10., s.decimals) + 1e-6;
+    long long count = (long long) floor(scaled);
+    double fraction = scaled - count;
+    _digits.assign(s.digits, '0');
+    long long divisor = 1;
+    for (int p = 0; p < s.digits; ++p) {
+        int d = (int) ((count / divisor) % 10);
+        double roll = s.roll && count % divisor == divisor - 1 ? fraction : 0.;
+        _digits[s.digits - 1 - p] = '0' + d;
+        cv::Mat window = img(cv::Rect(origin.x + (s.digits - 1 - p) * pitch, origin.y, s.digitWidth, s.digitHeight));
+        drawDrum(window, d, roll);
+        divisor *= 10;
+    }
+
+    // camera position
+    double angle = _rng.uniform(-s.rotation, s.rotation);
+    double shear = tan(_rng.uniform(-s.skew, s.skew) * CV_PI / 180.);
+    cv::Point2f center(s.width / 2.f, s.height / 2.f);
+    cv::Mat m = cv::getRotationMatrix2D(center, angle, 1.);
+    m.at<double>(0, 1) += shear;
+    m.at<double>(0, 2) -= shear * center.y;
+    cv::Mat warped;
+    cv::warpAffine(img, warped, m, img.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    img = warped;
+
+    // reflection: soft bright spot
+    double glare = _rng.uniform(0., s.glare);
+    if (glare >= 1.) {
+        cv::Mat spot = cv::Mat::zeros(img.size(), CV_8UC1);
+        int radius = (int) (_rng.uniform(0.05, 0.2) * s.width);
+        cv::Point position(_rng.uniform(0, s.width), _rng.uniform(0, s.height));
+        cv::circle(spot, position, radius, cv::Scalar::all(glare), -1);
+        cv::GaussianBlur(spot, spot, cv::Size(0, 0), radius / 2.);
+        cv::Mat spotColor;
+#if CV_MAJOR_VERSION == 2
+        cvtColor(spot, spotColor, CV_GRAY2BGR);
+#elif CV_MAJOR_VERSION == 3 | 4
+        cvtColor(spot, spotColor, cv::COLOR_GRAY2BGR);
+#endif
+        cv::add(img, spotColor, img);
+    }
+
+    double sigma = _rng.uniform(0., s.blur);
+    if (sigma >= 0.3) {
+        cv::GaussianBlur(img, img, cv::Size(0, 0), sigma);
+    }
+
+    if (s.noise > 0.) {
+        cv::Mat noise(img.size(), CV_16SC3);
+        _rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(s.noise));
+        cv::Mat sum;
+        img.convertTo(sum, CV_16SC3);
+        cv::add(sum, noise, sum);
+        sum.convertTo(img, CV_8UC3);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * MeterRenderer.h
+ *
+ * Synthetic images of a drum counter with a known value for load and
+ * accuracy tests. The counter is drawn with a Hershey font, the drums roll
+ * like on a real meter, the image is rotated and skewed, blurred and gets
+ * noise and a reflection. Rotation, skew, blur and reflection are drawn at
+ * random per image up to the values of the style.
+ *
+ */
+
+#ifndef METERRENDERER_H_
+#define METERRENDERER_H_
+
+#include <string>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Timestamp.h"
+
+struct MeterStyle {
+    MeterStyle();
+    // optional keys of a yml file, see README
+    bool load(const std::string & path);
+
+    int width;
+    int height;
+    int digits;
+    // digits after the decimal point
+    int decimals;
+    // simplex, plain, duplex, complex or triplex
+    std::string font;
+    int thickness;
+    // size of a drum window
+    int digitWidth;
+    int digitHeight;
+    // drums turn continuously instead of jumping to the next digit
+    bool roll;
+    // gray values
+    int background;
+    int drum;
+    int digit;
+    // maximum rotation and skew in degrees
+    double rotation;
+    double skew;
+    // maximum sigma of the gaussian blur
+    double blur;
+    // sigma of the noise
+    double noise;
+    // maximum brightness of the reflection 0..255
+    double glare;
+    // first value, increase per image and milliseconds between images
+    double start;
+    double step;
+    int interval;
+    unsigned seed;
+};
+
+class MeterRenderer {
+public:
+    // the first image is of the start time
+    MeterRenderer(const MeterStyle & style, const Timestamp & start);
+
+    // render the next image, value and time advance by step and interval
+    void next(cv::Mat & img);
+
+    // digits of the last image as read by a human, e.g. "0012345"
+    const std::string & digits() const {
+        return _digits;
+    }
+
+    double value() const {
+        return _value;
+    }
+
+    const Timestamp & time() const {
+        return _time;
+    }
+
+    void render(double value, cv::Mat & img);
+
+private:
+    void drawDrum(cv::Mat & window, int digit, double roll);
+
+    MeterStyle _style;
+    int _font;
+    cv::RNG _rng;
+    double _value;
+    Timestamp _time;
+    std::string _digits;
+    bool _started;
+    double _scale;
+};
+
+#endif /* METERRENDERER_H_ */
@@ -0,0 +1,250 @@
+/*
+ * Metrics.cpp
+ *
+ */
+
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Metrics.h"
+
+static const char * stageNames[STAGE_COUNT] = {
+    "input", "quality", "process", "skew", "digits", "ocr", "plausi", "rrd"
+};
+
+// FrameQuality::defectName of the quality counters
+static const char * qualityNames[] = {
+    "dark", "bright", "blurry", "edges"
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99 };
+
+LatencyHistogram::LatencyHistogram() :
+    _sum(0), _count(0) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        _buckets[i] = 0;
+    }
+}
+
+size_t LatencyHistogram::bucket(uint64_t micros) {
+    if (micros < SUB_BUCKETS) {
+        return micros;
+    }
+    if (micros >= (1ULL << MAX_BITS)) {
+        return BUCKETS - 1;
+    }
+    int msb = 63 - __builtin_clzll(micros);
+    int shift = msb - 3;
+    return (msb - 2) * SUB_BUCKETS + ((micros >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::lowerBound(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / SUB_BUCKETS - 1;
+    return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+}
+
+/**
+ * Quantile q (0..1) in seconds, the middle of its bucket.
+ */
+double LatencyHistogram::quantile(double q) const {
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0.;
+    }
+    uint64_t rank = (uint64_t) (q * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t cumulated = 0;
+    size_t i = 0;
+    for (; i < BUCKETS - 1; ++i) {
+        cumulated += counts[i];
+        if (cumulated >= rank) {
+            break;
+        }
+    }
+    return (lowerBound(i) + lowerBound(i + 1)) / 2e6;
+}
+
+Metrics::Metrics() {
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        _counters[i] = 0;
+    }
+}
+
+Metrics & Metrics::get() {
+    static Metrics metrics;
+    return metrics;
+}
+
+const char * Metrics::stageName(MetricsStage stage) {
+    return stageNames[stage];
+}
+
+std::string Metrics::prometheus() const {
+    std::ostringstream out;
+    out << "# HELP emeocv_stage_seconds Processing time of the pipeline stages.\n";
+    out << "# TYPE emeocv_stage_seconds summary\n";
+    for (size_t s = 0; s < STAGE_COUNT; ++s) {
+        const LatencyHistogram & h = _stages[s];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+            out << "emeocv_stage_seconds{stage=\"" << stageNames[s] << "\",quantile=\"" << quantiles[q] << "\"} "
+                << h.quantile(quantiles[q]) << "\n";
+        }
+        out << "emeocv_stage_seconds_sum{stage=\"" << stageNames[s] << "\"} " << h.sum() << "\n";
+        out << "emeocv_stage_seconds_count{stage=\"" << stageNames[s] << "\"} " << h.count() << "\n";
+    }
+    out << "# HELP emeocv_frames_total Processed images.\n";
+    out << "# TYPE emeocv_frames_total counter\n";
+    out << "emeocv_frames_total " << _counters[COUNTER_FRAMES] << "\n";
+    out << "# HELP emeocv_rejects_total Readings rejected by the plausibility check.\n";
+    out << "# TYPE emeocv_rejects_total counter\n";
+    out << "emeocv_rejects_total " << _counters[COUNTER_REJECTS] << "\n";
+    out << "# HELP emeocv_unrecognized_digits_total Digits the OCR could not recognize.\n";
+    out << "# TYPE emeocv_unrecognized_digits_total counter\n";
+    out << "emeocv_unrecognized_digits_total " << _counters[COUNTER_UNRECOGNIZED] << "\n";
+    out << "# HELP emeocv_contours_total Contours found in the edge images.\n";
+    out << "# TYPE emeocv_contours_total counter\n";
+    out << "emeocv_contours_total " << _counters[COUNTER_CONTOURS] << "\n";
+    out << "# HELP emeocv_quality_failed_total Frames failing the quality check.\n";
+    out << "# TYPE emeocv_quality_failed_total counter\n";
+    for (size_t c = COUNTER_QUALITY_DARK; c <= COUNTER_QUALITY_EDGES; ++c) {
+        out << "emeocv_quality_failed_total{reason=\"" << qualityNames[c - COUNTER_QUALITY_DARK] << "\"} "
+            << _counters[c] << "\n";
+    }
+    out << "# HELP emeocv_quality_skipped_total Frames not processed because of their quality.\n";
+    out << "# TYPE emeocv_quality_skipped_total counter\n";
+    out << "emeocv_quality_skipped_total " << _counters[COUNTER_QUALITY_SKIPPED] << "\n";
+    return out.str();
+}
+
+/**
+ * {"frames":10,"rejects":1,"unrecognized":2,"contours":4711,
+ *  "quality":{"dark":0,"bright":1,"blurry":0,"edges":0,"skipped":1},
+ *  "stages":{"input":{"count":10,"sum":0.1,"p50":0.01,"p90":0.012,"p99":0.02},...}}
+ */
+std::string Metrics::json() const {
+    std::ostringstream out;
+    out << "{\"frames\":" << _counters[COUNTER_FRAMES]
+        << ",\"rejects\":" << _counters[COUNTER_REJECTS]
+        << ",\"unrecognized\":" << _counters[COUNTER_UNRECOGNIZED]
+        << ",\"contours\":" << _counters[COUNTER_CONTOURS]
+        << ",\"quality\":{\"dark\":" << _counters[COUNTER_QUALITY_DARK]
+        << ",\"bright\":" << _counters[COUNTER_QUALITY_BRIGHT]
+        << ",\"blurry\":" << _counters[COUNTER_QUALITY_BLURRY]
+        << ",\"edges\":" << _counters[COUNTER_QUALITY_EDGES]
+        << ",\"skipped\":" << _counters[COUNTER_QUALITY_SKIPPED] << "}"
+        << ",\"stages\":{";
+    for (size_t s = 0; s < STAGE_COUNT; ++s) {
+        const LatencyHistogram & h = _stages[s];
+        out << (s > 0 ? "," : "") << "\"" << stageNames[s] << "\":{\"count\":" << h.count()
+            << ",\"sum\":" << h.sum() << ",\"p50\":" << h.quantile(0.5) << ",\"p90\":" << h.quantile(0.9)
+            << ",\"p99\":" << h.quantile(0.99) << "}";
+    }
+    out << "}}";
+    return out.str();
+}
+
+MetricsServer::MetricsServer(const std::string & address, int port) :
+    _fd(-1), _stop(false) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        rlog << log4cpp::Priority::ERROR << "Invalid metrics address " << address;
+        return;
+    }
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    if (_fd == -1 || setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+            || bind(_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(_fd, 4) != 0) {
+        rlog << log4cpp::Priority::ERROR << "Can't listen on " << address << ":" << port << " :" << std::strerror(errno);
+        if (_fd != -1) {
+            close(_fd);
+            _fd = -1;
+        }
+        return;
+    }
+    rlog << log4cpp::Priority::INFO << "Metrics on http://" << address << ":" << port << "/metrics";
+    _thread = std::thread(&MetricsServer::run, this);
+}
+
+MetricsServer::~MetricsServer() {
+    _stop = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    if (_fd != -1) {
+        close(_fd);
+    }
+}
+
+void MetricsServer::run() {
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    while (!_stop) {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        int fd = accept4(_fd, 0, 0, SOCK_CLOEXEC);
+        if (fd != -1) {
+            answer(fd);
+            close(fd);
+        }
+    }
+}
+
+/**
+ * Read the request head, a slow client must not block the server.
+ */
+void MetricsServer::answer(int fd) {
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buf[1024];
+    ssize_t len;
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192
+            && (len = read(fd, buf, sizeof(buf))) > 0) {
+        request.append(buf, len);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        body = Metrics::get().prometheus();
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n" << body;
+    std::string data = response.str();
+    // a client closing early must not kill the process with SIGPIPE
+    for (size_t pos = 0; pos < data.size() && (len = send(fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL)) > 0;) {
+        pos += len;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Metrics.h
+ *
+ * Processing time of the pipeline stages and event counters. Recording is
+ * lock free: a stage time is one relaxed atomic increment in a histogram
+ * with log-linear buckets (8 per power of two, about 12% resolution), so
+ * it can stay enabled in production. MetricsServer exports the values in
+ * the Prometheus text format, MetricsSink publishes them to MQTT.
+ *
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Trace.h"
+
+enum MetricsStage {
+    STAGE_INPUT,
+    STAGE_QUALITY,
+    STAGE_PROCESS,
+    STAGE_SKEW,
+    STAGE_DIGITS,
+    STAGE_OCR,
+    STAGE_PLAUSI,
+    STAGE_RRD,
+    STAGE_COUNT
+};
+
+enum MetricsCounter {
+    COUNTER_FRAMES,
+    COUNTER_REJECTS,
+    COUNTER_UNRECOGNIZED,
+    COUNTER_CONTOURS,
+    // frames failing the quality check, by FrameDefect
+    COUNTER_QUALITY_DARK,
+    COUNTER_QUALITY_BRIGHT,
+    COUNTER_QUALITY_BLURRY,
+    COUNTER_QUALITY_EDGES,
+    // failed frames that were not processed
+    COUNTER_QUALITY_SKIPPED,
+    COUNTER_COUNT
+};
+
+/**
+ * Histogram of durations in microseconds.
+ */
+class LatencyHistogram {
+public:
+    enum { SUB_BUCKETS = 8, MAX_BITS = 32, BUCKETS = (MAX_BITS - 2) * SUB_BUCKETS };
+
+    LatencyHistogram();
+
+    void record(uint64_t micros) {
+        _buckets[bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(micros, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    // seconds
+    double sum() const {
+        return _sum.load(std::memory_order_relaxed) / 1e6;
+    }
+
+    double quantile(double q) const;
+
+    static size_t bucket(uint64_t micros);
+    static uint64_t lowerBound(size_t bucket);
+
+private:
+    std::atomic<uint64_t> _buckets[BUCKETS];
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _count;
+};
+
+class Metrics {
+public:
+    static Metrics & get();
+
+    void record(MetricsStage stage, uint64_t micros) {
+        _stages[stage].record(micros);
+    }
+
+    void count(MetricsCounter counter, uint64_t n = 1) {
+        _counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::string prometheus() const;
+    std::string json() const;
+
+    static const char * stageName(MetricsStage stage);
+
+private:
+    Metrics();
+
+    LatencyHistogram _stages[STAGE_COUNT];
+    std::atomic<uint64_t> _counters[COUNTER_COUNT];
+};
+
+/**
+ * Records the time from construction to destruction as a stage,
+ * and as a trace event while tracing.
+ */
+class StageTimer {
+public:
+    StageTimer(MetricsStage stage) :
+        _stage(stage), _trace(Trace::enabled() ? Metrics::stageName(stage) : 0),
+        _start(std::chrono::steady_clock::now()) {
+    }
+
+    ~StageTimer() {
+        Metrics::get().record(_stage, std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - _start).count());
+    }
+
+    void arg(const char * name, int64_t value) {
+        _trace.arg(name, value);
+    }
+
+private:
+    MetricsStage _stage;
+    TraceScope _trace;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * Minimal HTTP server for Prometheus, answers every request with the metrics.
+ */
+class MetricsServer {
+public:
+    MetricsServer(const std::string & address, int port);
+    ~MetricsServer();
+
+private:
+    void run();
+    void answer(int fd);
+
+    int _fd;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+};
+
+#endif /* METRICS_H_ */
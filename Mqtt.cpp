@@ -0,0 +1,211 @@
+/*
+ * Mqtt.cpp
+ *
+ */
+
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Mqtt.h"
+
+const int mqtt_keepalive = 60;
+
+template<typename ... Args>
+std::string string_format( const std::string & format, Args ... args ) {
+    size_t size = snprintf( nullptr, 0, format.c_str(), args ... ) + 1;
+    if( size <= 0 ) {
+        throw std::runtime_error( "Error during formatting." );
+    }
+    std::unique_ptr<char[]> buf( new char[ size ] );
+    snprintf( buf.get(), size, format.c_str(), args ... );
+    return std::string( buf.get(), buf.get() + size - 1 );
+}
+
+mosquittoPP::mosquittoPP(const char * id, bool clean_session, const char * hostname):
+    mosqpp::mosquittopp(id, clean_session), _hostname(hostname),
+    _host("localhost"), _port(1883), _connected(false) {
+    _topicLwt = make_topic(TOPIC_LWT);
+    _topicSensor = make_topic(TOPIC_SENSOR);
+    _payload.reserve(256);
+}
+
+void mosquittoPP::set_server(const std::string & host, int port) {
+    _host = host;
+    _port = port;
+}
+
+int mosquittoPP::connect_server() {
+    return connect(_host.c_str(), _port, mqtt_keepalive);
+}
+
+std::string mosquittoPP::make_topic(const std::string & tmpl) {
+    return make_topic(tmpl, _hostname);
+}
+
+std::string mosquittoPP::make_topic(const std::string & tmpl, const std::string & name) {
+    return string_format(tmpl, name.c_str());
+}
+
+void mosquittoPP::publish_lwt(bool online) {
+    const char * msg = online ? ONLINE : OFFLINE;
+    publish(NULL, _topicLwt.c_str(), strlen(msg), msg, 0, true);
+}
+
+void mosquittoPP::append_state(double gas_value, const Timestamp & time) {
+    char buf[96];
+    size_t len = time.format(buf, sizeof(buf), "{\"Time\":\"%Y-%m-%dT%H:%M:%S");
+    snprintf(buf + len, sizeof(buf) - len, "\",\"GAS\":%.3f}", gas_value);
+    _payload.append(buf);
+}
+
+/**
+ * Publish {"Time":"2019-04-01T12:00:00.123","GAS":835.995}
+ */
+int mosquittoPP::publish_state(double gas_value, const Timestamp & time, int * mid) {
+    return publish_state(_topicSensor, gas_value, time, mid);
+}
+
+int mosquittoPP::publish_state(const std::string & topic, double gas_value, const Timestamp & time, int * mid) {
+    std::lock_guard<std::mutex> lock(_payloadMutex);
+    _payload.clear();
+    append_state(gas_value, time);
+    return publish(mid, topic.c_str(), _payload.length(), _payload.c_str(), 1, false);
+}
+
+/**
+ * Publish several states as one JSON array.
+ */
+int mosquittoPP::publish_states(const std::vector<std::pair<Timestamp, double> > & states, int * mid) {
+    return publish_states(_topicSensor, states, mid);
+}
+
+int mosquittoPP::publish_states(const std::string & topic, const std::vector<std::pair<Timestamp, double> > & states,
+                                int * mid) {
+    std::lock_guard<std::mutex> lock(_payloadMutex);
+    _payload.clear();
+    _payload.push_back('[');
+    for (size_t i = 0; i < states.size(); ++i) {
+        if (i > 0) {
+            _payload.push_back(',');
+        }
+        append_state(states[i].second, states[i].first);
+    }
+    _payload.push_back(']');
+    return publish(mid, topic.c_str(), _payload.length(), _payload.c_str(), 1, false);
+}
+
+void mosquittoPP::on_connect(int rc) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    switch (rc) {
+    case 0:
+        rlog << log4cpp::Priority::INFO << "Connected to mqtt server.";
+        _connected = true;
+        subscribe(NULL, "stat/+/POWER", 0);
+        publish_lwt(true);
+        break;
+    case 1:
+        rlog << log4cpp::Priority::ERROR << "Connection refused (unacceptable protocol version).";
+        break;
+    case 2:
+        rlog << log4cpp::Priority::ERROR << "Connection refused (identifier rejected).";
+        break;
+    case 3:
+        rlog << log4cpp::Priority::ERROR << "Connection refused (broker unavailable).";
+        break;
+    default:
+        rlog << log4cpp::Priority::ERROR << "Unknown connection error. (%s)" << mosqpp::strerror(rc);
+        break;
+    }
+    if (rc != 0) {
+        sleep(10);
+    }
+}
+
+void mosquittoPP::on_disconnect(int rc) {
+    _connected = false;
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Disconnected from mqtt server (" << rc << ").";
+}
+
+void mosquittoPP::on_publish(int mid) {
+    std::lock_guard<std::mutex> lock(_ackedMutex);
+    _acked.push_back(mid);
+    if (_acked.size() > 1024) {
+        _acked.pop_front();
+    }
+}
+
+bool mosquittoPP::is_acked(int mid) {
+    std::lock_guard<std::mutex> lock(_ackedMutex);
+    return std::find(_acked.begin(), _acked.end(), mid) != _acked.end();
+}
+
+/**
+ * Network loop with reconnect, run in a thread of its own until stop is set.
+ */
+void mosquittoPP::run(const volatile bool & stop) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+
+    while (!stop) {
+        int res = loop(1000, 1);
+        switch (res) {
+        case MOSQ_ERR_SUCCESS:
+            break;
+        case MOSQ_ERR_NO_CONN: {
+            int res = connect_server();
+            if (res) {
+                rlog << log4cpp::Priority::ERROR << "Can't connect to Mosquitto server %s" << mosqpp::strerror(res);
+                sleep(30);
+            }
+            break;
+        }
+        case MOSQ_ERR_INVAL:
+        case MOSQ_ERR_NOMEM:
+        case MOSQ_ERR_CONN_LOST:
+        case MOSQ_ERR_PROTOCOL:
+        case MOSQ_ERR_ERRNO:
+            rlog << log4cpp::Priority::ERROR <<  strerror(errno) << " " << mosqpp::strerror(res);
+            disconnect();
+            _connected = false;
+            rlog << log4cpp::Priority::ERROR << "disconnected";
+            sleep(10);
+            rlog << log4cpp::Priority::ERROR << "Try to reconnect";
+            int res = connect_server();
+            if (res) {
+                rlog << log4cpp::Priority::ERROR << "Can't connect to Mosquitto server " << mosqpp::strerror(res);
+            } else {
+                rlog << log4cpp::Priority::ERROR << "Connected";
+            }
+            break;
+        }
+    }
+}
+
+MqttConnection::MqttConnection(const std::string & hostname, const Config & config) :
+    _stop(false) {
+    mosqpp::lib_init();
+    _mosq = new mosquittoPP(hostname.c_str(), true, hostname.c_str());
+    _mosq->set_server(config.getMqttHost(), config.getMqttPort());
+    _mosq->username_pw_set("owntracks", "zhopa");
+    _mosq->will_set(_mosq->make_topic(TOPIC_LWT).c_str(), strlen(OFFLINE), OFFLINE, 0, true);
+    _mosq->connect_server();
+    _thread = std::thread([this]() {
+        _mosq->run(_stop);
+    });
+}
+
+MqttConnection::~MqttConnection() {
+    _stop = true;
+    _mosq->publish_lwt(false);
+    _mosq->disconnect();
+    _thread.join();
+    delete _mosq;
+    mosqpp::lib_cleanup();
+}
@@ -0,0 +1,94 @@
+/*
+ * Mqtt.h
+ *
+ * Connection to the MQTT broker that receives the meter readings.
+ *
+ */
+
+#ifndef MQTT_H_
+#define MQTT_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <mosquittopp.h>
+
+#include "Config.h"
+#include "Timestamp.h"
+
+#define ONLINE "Online"
+#define OFFLINE "Offline"
+
+#define TOPIC_LWT "tele/%s/LWT"
+#define TOPIC_SENSOR "tele/%s/SENSOR"
+#define TOPIC_METRICS "tele/%s/METRICS"
+
+extern const int mqtt_keepalive;
+
+class mosquittoPP : public mosqpp::mosquittopp {
+public:
+    //using  mosqpp::mosquittopp::mosquittopp;
+    mosquittoPP(const char * id = NULL, bool clean_session = true, const char * hostname = "unknown");
+    void set_server(const std::string & host, int port);
+    int connect_server();
+    void publish_lwt(bool online);
+    int publish_state(double gas_value, const Timestamp & time, int * mid = NULL);
+    int publish_states(const std::vector<std::pair<Timestamp, double> > & states, int * mid = NULL);
+    int publish_state(const std::string & topic, double gas_value, const Timestamp & time, int * mid = NULL);
+    int publish_states(const std::string & topic, const std::vector<std::pair<Timestamp, double> > & states,
+                       int * mid = NULL);
+    void on_connect(int rc);
+    void on_disconnect(int rc);
+    void on_publish(int mid);
+    void run(const volatile bool & stop);
+
+    bool is_connected() const {
+        return _connected;
+    }
+
+    // states are published with QoS 1
+    bool is_acked(int mid);
+
+    std::string make_topic(const std::string & tmpl);
+    std::string make_topic(const std::string & tmpl, const std::string & name);
+private:
+    void append_state(double gas_value, const Timestamp & time);
+
+    std::string _hostname = "unknown";
+    std::string _host;
+    int _port;
+    std::atomic<bool> _connected;
+    // mids of the recently acknowledged messages
+    std::deque<int> _acked;
+    std::mutex _ackedMutex;
+    std::string _topicLwt;
+    std::string _topicSensor;
+    // reused for every message, publish may be called by several sinks
+    std::string _payload;
+    std::mutex _payloadMutex;
+};
+
+/**
+ * Broker connection with its network thread. Shared by the MQTT sinks of
+ * all meters of the process, the client id is the hostname.
+ */
+class MqttConnection {
+public:
+    MqttConnection(const std::string & hostname, const Config & config);
+    ~MqttConnection();
+
+    mosquittoPP & client() {
+        return *_mosq;
+    }
+
+private:
+    mosquittoPP * _mosq;
+    volatile bool _stop;
+    std::thread _thread;
+};
+
+#endif /* MQTT_H_ */
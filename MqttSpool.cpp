@@ -0,0 +1,191 @@
+/*
+ * MqttSpool.cpp
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "MqttSpool.h"
+
+MqttSpool::MqttSpool() :
+    _fd(-1), _maxRecords(0), _read(0), _end(0), _saved(0), _dropped(0) {
+}
+
+MqttSpool::~MqttSpool() {
+    close();
+}
+
+/**
+ * Open or create the spool file, at most maxRecords values are kept.
+ * A partially written record at the end is cut off.
+ */
+bool MqttSpool::open(const std::string & path, size_t maxRecords) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    close();
+    _path = path;
+    _maxRecords = maxRecords > 0 ? maxRecords : 1;
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (_fd == -1) {
+        rlog << log4cpp::Priority::ERROR << "Can't open spool " << path << " :" << std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    fstat(_fd, &st);
+    _end = st.st_size / sizeof(MqttSpoolRecord);
+    if ((off_t) (_end * sizeof(MqttSpoolRecord)) != st.st_size && ftruncate(_fd, _end * sizeof(MqttSpoolRecord)) != 0) {
+        rlog << log4cpp::Priority::ERROR << "Can't cut off partial record of spool " << path << " :" << std::strerror(errno);
+    }
+
+    _read = 0;
+    std::ifstream pos((_path + ".pos").c_str());
+    pos >> _read;
+    if (_read > _end) {
+        _read = _end;
+    }
+    _saved = _read;
+    if (size() > 0) {
+        rlog << log4cpp::Priority::INFO << "Spool " << path << " holds " << size() << " values";
+    }
+    return true;
+}
+
+void MqttSpool::close() {
+    if (_fd != -1) {
+        sync();
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+/**
+ * Append a value, the oldest value is dropped if the spool is full.
+ */
+bool MqttSpool::append(const Timestamp & time, double value) {
+    if (_fd == -1) {
+        return false;
+    }
+    if (size() >= _maxRecords) {
+        ++_read;
+        if (++_dropped % 1000 == 1) {
+            log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Spool full, dropped oldest value (" << _dropped << " total)";
+        }
+    }
+    MqttSpoolRecord record = { time.micros(), value };
+    if (write(_fd, &record, sizeof(record)) != sizeof(record)) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't write spool " << _path << " :" << std::strerror(errno);
+        if (ftruncate(_fd, _end * sizeof(MqttSpoolRecord)) != 0) {
+            log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't cut off partial record of spool " << _path
+                                         << " :" << std::strerror(errno);
+        }
+        return false;
+    }
+    ++_end;
+    return true;
+}
+
+/**
+ * At most max unpublished values, starting offset values after the oldest.
+ */
+size_t MqttSpool::peek(size_t offset, size_t max, std::vector<std::pair<Timestamp, double> > & values) const {
+    values.clear();
+    if (offset >= size()) {
+        return 0;
+    }
+    size_t count = size() - offset < max ? size() - offset : max;
+    std::vector<MqttSpoolRecord> records(count);
+    ssize_t len = pread(_fd, records.data(), count * sizeof(MqttSpoolRecord), (_read + offset) * sizeof(MqttSpoolRecord));
+    for (ssize_t i = 0; len > 0 && i < len / (ssize_t) sizeof(MqttSpoolRecord); ++i) {
+        values.push_back(std::make_pair(Timestamp::fromMicros(records[i].time), records[i].value));
+    }
+    return values.size();
+}
+
+/**
+ * Mark the oldest count values as published.
+ */
+void MqttSpool::consume(size_t count) {
+    _read += count < size() ? count : size();
+}
+
+/**
+ * Save the read position and reclaim the space of published values.
+ * Called regularly, not after every value, to spare the flash memory.
+ */
+void MqttSpool::sync() {
+    if (_fd == -1) {
+        return;
+    }
+    if (_read == _end && _end > 0) {
+        // everything published: start over
+        if (ftruncate(_fd, 0) == 0) {
+            _read = _end = 0;
+        } else {
+            log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't truncate spool " << _path << " :" << std::strerror(errno);
+        }
+    } else if (_read >= _maxRecords) {
+        compact();
+    }
+    if (_read != _saved && savePosition(_read)) {
+        _saved = _read;
+    }
+}
+
+/**
+ * The position is synced before the rename, a crash leaves the old or the new one.
+ */
+bool MqttSpool::savePosition(uint64_t read) {
+    std::string posFile = _path + ".pos";
+    std::string tmpFile = posFile + ".tmp";
+    std::string data = std::to_string(read) + "\n";
+    int fd = ::open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd != -1 && write(fd, data.data(), data.size()) == (ssize_t) data.size() && fsync(fd) == 0;
+    if (fd != -1 && ::close(fd) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmpFile.c_str(), posFile.c_str()) != 0) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't write " << posFile << " :" << std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Copy the unpublished values into a new file.
+ * The position is reset before the file is replaced: a crash in between
+ * publishes values again instead of losing them.
+ */
+bool MqttSpool::compact() {
+    std::string tmpFile = _path + ".tmp";
+    int fd = ::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    std::vector<MqttSpoolRecord> records(size());
+    size_t len = records.size() * sizeof(MqttSpoolRecord);
+    if (pread(_fd, records.data(), len, _read * sizeof(MqttSpoolRecord)) != (ssize_t) len
+            || write(fd, records.data(), len) != (ssize_t) len
+            || fsync(fd) != 0
+            || !savePosition(0)
+            || rename(tmpFile.c_str(), _path.c_str()) != 0) {
+        ::close(fd);
+        unlink(tmpFile.c_str());
+        return false;
+    }
+    ::close(_fd);
+    _fd = fd;
+    _end = records.size();
+    _read = 0;
+    _saved = 0;
+    return true;
+}
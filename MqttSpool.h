@@ -0,0 +1,62 @@
+/*
+ * MqttSpool.h
+ *
+ * Durable queue of values that could not be published, so that they
+ * survive broker outages and restarts. Values are appended to a segment
+ * file of fixed size records; the index of the first unpublished record
+ * is kept in <file>.pos. Delivery is at least once: after a crash the
+ * values since the last saved position are published again.
+ *
+ */
+
+#ifndef MQTTSPOOL_H_
+#define MQTTSPOOL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Timestamp.h"
+
+struct MqttSpoolRecord {
+    int64_t time;
+    double value;
+};
+
+class MqttSpool {
+public:
+    MqttSpool();
+    ~MqttSpool();
+
+    bool open(const std::string & path, size_t maxRecords);
+    void close();
+    bool append(const Timestamp & time, double value);
+    size_t peek(size_t offset, size_t max, std::vector<std::pair<Timestamp, double> > & values) const;
+    void consume(size_t count);
+    void sync();
+
+    bool isOpen() const {
+        return _fd != -1;
+    }
+
+    // number of unpublished values
+    size_t size() const {
+        return _end - _read;
+    }
+
+private:
+    bool savePosition(uint64_t read);
+    bool compact();
+
+    std::string _path;
+    int _fd;
+    size_t _maxRecords;
+    // record indexes
+    uint64_t _read;
+    uint64_t _end;
+    uint64_t _saved;
+    unsigned long _dropped;
+};
+
+#endif /* MQTTSPOOL_H_ */
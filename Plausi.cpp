@@ -4,103 +4,358 @@
  */
 
 #include <string>
+#include <algorithm>
 #include <deque>
 #include <utility>
+#include <vector>
+#include <fstream>
+#include <sstream>
 #include <ctime>
 #include <cstdlib>
 #include <math.h>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <log4cpp/Category.hh>
 #include <log4cpp/Priority.hh>
 
 #include "Plausi.h"
+#include "Log.h"
+#include "Metrics.h"
 
-Plausi::Plausi(double maxPower, size_t window) :
-    _maxPower(maxPower), _window(window), _value(-1.), _time(0) {
+/**
+ * Without median the values in the window must all be ascending and below maxPower,
+ * the center value is the candidate.
+ * With median outliers are dropped and the median of the window is the candidate.
+ * This allows large windows that tolerate single misread values.
+ * With reconcile unknown digits are filled in from the last checked value, a read digit
+ * that contradicts it rejects the reading.
+ */
+Plausi::Plausi(double maxPower, size_t window, bool median, bool reconcile, const MeterLayout & layout) :
+    _maxPower(maxPower), _window(window), _median(median), _reconcile(reconcile), _layout(layout),
+    _descending(0), _overPower(0), _outliers(0), _value(-1.), _stateMaxAge(0) {
+}
+
+Plausi::~Plausi() {
+    if (_value >= 0.) {
+        saveState(true);
+    }
 }
 
-bool Plausi::check(const std::string& value, time_t time) {
+/**
+ * Keep checked value and window in stateFile to continue after a restart.
+ * A state older than maxAge seconds is ignored.
+ */
+void Plausi::setStateFile(const std::string & stateFile, int maxAge) {
+    _stateFile = stateFile;
+    _stateMaxAge = maxAge;
+    loadState();
+}
+
+void Plausi::loadState() {
     log4cpp::Category& rlog = log4cpp::Category::getRoot();
-    if (rlog.isInfoEnabled()) {
-        rlog.info("Plausi check: %s of %s", value.c_str(), ctime(&time));
+    std::ifstream state(_stateFile.c_str());
+    if (!state) {
+        return;
+    }
+    double value;
+    double checkedTime;
+    size_t size;
+    state >> value >> checkedTime >> size;
+    if (!state || size > 100000) {
+        rlog.error("Plausi: invalid state file %s", _stateFile.c_str());
+        return;
+    }
+    if (time(NULL) - (time_t) checkedTime > _stateMaxAge) {
+        rlog.info("Plausi: state in %s is too old", _stateFile.c_str());
+        return;
+    }
+    std::deque<std::pair<Timestamp, double> > queue;
+    for (size_t i = 0; i < size; ++i) {
+        double t;
+        double v;
+        state >> t >> v;
+        queue.push_back(std::make_pair(Timestamp::fromSeconds(t), v));
+    }
+    if (!state) {
+        rlog.error("Plausi: invalid state file %s", _stateFile.c_str());
+        return;
+    }
+
+    _value = value;
+    _time = Timestamp::fromSeconds(checkedTime);
+    for (size_t i = 0; i < queue.size(); ++i) {
+        push(queue[i].first, queue[i].second);
+    }
+    // window may have been changed in the meantime
+    while (_queue.size() > _window) {
+        pop();
+    }
+    rlog.info("Plausi: continue with %.3f of %s", _value, _time.toString().c_str());
+}
+
+/**
+ * Write the state to a temporary file and rename it, so that the state file is always complete.
+ * The file is synced before the rename, otherwise a power loss may leave an empty state file.
+ * Written at most once a minute of reading time to spare the SD card, unless forced.
+ */
+void Plausi::saveState(bool force) {
+    if (_stateFile.empty() || (!force && !(_time < _stateSaved) && _time - _stateSaved < 60.)) {
+        return;
+    }
+    _stateSaved = _time;
+    std::ostringstream state;
+    // times as seconds with microseconds
+    state.precision(6);
+    state << std::fixed << _value << " " << _time.seconds() << " " << _queue.size() << "\n";
+    for (size_t i = 0; i < _queue.size(); ++i) {
+        state << _queue[i].first.seconds() << " " << _queue[i].second << "\n";
+    }
+    std::string data = state.str();
+    std::string tmpFile = _stateFile + ".tmp";
+    int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd != -1 && write(fd, data.data(), data.size()) == (ssize_t) data.size() && fsync(fd) == 0;
+    if (fd != -1 && close(fd) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmpFile.c_str(), _stateFile.c_str()) != 0) {
+        log4cpp::Category::getRoot().error("Plausi: can't write %s: %s", _stateFile.c_str(), strerror(errno));
     }
+}
+
+/**
+ * Align the OCR result with the last checked value.
+ * Since the last check the counter can only have moved within [_value, _value + maxPower * dt],
+ * the latest reading in the window raises the lower bound.
+ * Leading digits that are equal for both bounds are known: a '?' there is filled in, a
+ * different read digit is a misread and an empty string is returned to reject the reading.
+ * Up to 3 remaining '?' are replaced by the smallest digits that keep the value in range.
+ * Returns the unchanged value if there is no last checked value or no possible fill.
+ */
+std::string Plausi::reconcile(const std::string & value, const Timestamp & time) const {
+    size_t len = value.length();
+    if (_value < 0. || time < _time || len < (size_t) (_layout.digits() - _layout.decimals())
+            || len > (size_t) _layout.digits()) {
+        return value;
+    }
+
+    // bounds with all digits 00835995, cut to the length of value
+    double maxValue = _value + _maxPower * (time - _time) / 3600.;
+    double minValue = _value;
+    if (!_queue.empty() && _queue.back().first <= time
+            && _queue.back().second > minValue && _queue.back().second <= maxValue) {
+        // the latest reading is a closer lower bound
+        minValue = _queue.back().second;
+    }
+    double scale = _layout.scale();
+    std::string lo = _layout.format((long long) floor(minValue * scale + 0.5)).substr(0, len);
+    // not beyond 99999999
+    long long maxCount = std::min((long long) floor(maxValue * scale), (long long) pow(10., _layout.digits()) - 1);
+    std::string hi = _layout.format(maxCount).substr(0, len);
+    if (lo.length() != len || hi.length() != len) {
+        return value;
+    }
+
+    std::string result(value);
+    size_t i = 0;
+    for (; i < len && lo[i] == hi[i]; ++i) {
+        if (result[i] == '?') {
+            result[i] = lo[i];
+        } else if (result[i] != lo[i]) {
+            return std::string();
+        }
+    }
+
+    std::vector<size_t> unknown;
+    for (; i < len; ++i) {
+        if (result[i] == '?') {
+            unknown.push_back(i);
+        }
+    }
+    if (unknown.size() > 3) {
+        return value;
+    }
+
+    // try fills in ascending order, digit values starting at the digit of the lower bound
+    int combinations = 1;
+    for (size_t k = 0; k < unknown.size(); ++k) {
+        combinations *= 10;
+    }
+    std::string best;
+    for (int c = 0; c < combinations; ++c) {
+        std::string candidate(result);
+        int rest = c;
+        for (size_t k = unknown.size(); k-- > 0; ) {
+            candidate[unknown[k]] = '0' + (lo[unknown[k]] - '0' + rest % 10) % 10;
+            rest /= 10;
+        }
+        // digit strings of equal length compare like numbers
+        if (candidate >= lo && candidate <= hi && (best.empty() || candidate < best)) {
+            best = candidate;
+        }
+    }
+    return best.empty() ? value : best;
+}
+
+/**
+ * Power between two readings.
+ * Readings within the same microsecond have infinite power unless the value did not increase.
+ */
+double Plausi::power(const std::pair<Timestamp, double> & from, const std::pair<Timestamp, double> & to) const {
+    double dt = to.first - from.first;
+    if (dt <= 0.) {
+        return to.second > from.second ? INFINITY : 0.;
+    }
+    return (to.second - from.second) / dt * 3600.;
+}
+
+/**
+ * A value is an outlier if it deviates from the median of the window by more
+ * than the consumption at maxPower over the time span of the window.
+ */
+bool Plausi::isOutlier(const Timestamp & time, double value) const {
+    double span = time - _queue.front().first;
+    double tolerance = _maxPower * span / 3600. + 0.001;
+    return fabs(value - _rollingMedian.median()) > tolerance;
+}
+
+/**
+ * Append value to the window and update neighbor counts in O(1) and the median in O(log n).
+ */
+void Plausi::push(const Timestamp & time, double value) {
+    std::pair<Timestamp, double> item(time, value);
+    if (!_queue.empty()) {
+        if (value < _queue.back().second) {
+            ++_descending;
+        }
+        if (power(_queue.back(), item) > _maxPower) {
+            ++_overPower;
+        }
+    }
+    _queue.push_back(item);
+    if (_median) {
+        _rollingMedian.insert(value, time);
+    }
+}
+
+/**
+ * Remove the oldest value from the window.
+ */
+void Plausi::pop() {
+    if (_queue.size() > 1) {
+        if (_queue[1].second < _queue[0].second) {
+            --_descending;
+        }
+        if (power(_queue[0], _queue[1]) > _maxPower) {
+            --_overPower;
+        }
+    }
+    if (_median) {
+        _rollingMedian.erase(_queue.front().second, _queue.front().first);
+    }
+    _queue.pop_front();
+}
+
+bool Plausi::check(const std::string& value, const Timestamp & time) {
+    StageTimer timer(STAGE_PLAUSI);
+    LOG_INFO("Plausi check: %s of %s", value.c_str(), time.toString().c_str());
+    std::string checked = value;
+    if (_reconcile) {
+        checked = reconcile(value, time);
+        if (checked.empty()) {
+            LOG_INFO("Plausi rejected: %s contradicts the last checked value %.3f", value.c_str(), _value);
+            Metrics::get().count(COUNTER_REJECTS);
+            return false;
+        }
+        if (checked != value) {
+            LOG_INFO("Plausi reconciled: %s -> %s", value.c_str(), checked.c_str());
+        }
+    }
+    bool result = checkValue(checked, time);
+    if (!result) {
+        Metrics::get().count(COUNTER_REJECTS);
+    }
+    return result;
+}
+
+bool Plausi::checkValue(const std::string& value, const Timestamp & time) {
     //00835.995
     int vLen = value.length();
 
-    if ((_queue.size() == 0 ) && (vLen != 8 )) {
-        rlog.info("Plausi rejected: first time only 8 digits required '%s'", value.c_str());
+    if ((_queue.size() == 0 ) && (_value < 0.) && (vLen != _layout.digits())) {
+        LOG_INFO("Plausi rejected: first time all %d digits required '%s'", _layout.digits(), value.c_str());
         return false;
     }
 
-    if (vLen < 5 || vLen > 8 ) {
-        rlog.info("Plausi rejected: exactly %d digits", vLen );
+    // missing last decimals are read as 0: 0083599 = 835.99
+    double dval;
+    if (!_layout.value(value, dval)) {
+        LOG_INFO("Plausi rejected: no %d to %d digits '%s'", _layout.digits() - _layout.decimals(),
+                 _layout.digits(), value.c_str());
         return false;
     }
-    if (value.find_first_of('?') != std::string::npos) {
-        // no '?' char
-        rlog.info("Plausi rejected: no '?' char");
-        return false;
+
+    if (_median && _queue.size() >= 3 && isOutlier(time, dval)) {
+        LOG_INFO("Plausi rejected: value %.3f is an outlier to median %.3f", dval, _rollingMedian.median());
+        if (++_outliers <= _window / 2) {
+            return false;
+        }
+        // the window itself holds wrong values: start again
+        LOG_INFO("Plausi: too many outliers, reset window");
+        while (!_queue.empty()) {
+            pop();
+        }
     }
-    //5  = 1
-    //6  = 10
-    //7  = 100
-    //8  = 1000
-    double dval = atof(value.c_str()) / pow(10.,vLen - 5.  );
-    _queue.push_back(std::make_pair(time, dval));
+    _outliers = 0;
+    push(time, dval);
 
     if (_queue.size() < _window) {
-        rlog.info("Plausi rejected: not enough values: %d", _queue.size());
+        LOG_INFO("Plausi rejected: not enough values: %d", (int) _queue.size());
         return false;
     }
     if (_queue.size() > _window) {
-        _queue.pop_front();
-    }
-
-    // iterate through queue and check that all values are ascending
-    // and consumption of energy is less than limit
-    std::deque<std::pair<time_t, double> >::const_iterator it = _queue.begin();
-    time = it->first;
-    dval = it->second;
-    ++it;
-    while (it != _queue.end()) {
-        if (it->second < dval) {
-            // value must be >= previous value
-            rlog.info("Plausi rejected: value %.3f must be >= previous value %.3f", it->second, dval);
+        pop();
+    }
+
+    Timestamp candTime = _queue[_queue.size() / 2].first;
+    double candValue = _queue[_queue.size() / 2].second;
+    if (_median) {
+        // the median is a value of the window, take its time
+        candTime = _rollingMedian.medianTime();
+        candValue = _rollingMedian.median();
+    } else {
+        // all values in queue must be ascending
+        // and consumption of energy must be less than limit
+        if (_descending > 0) {
+            LOG_INFO("Plausi rejected: %d values must be >= previous value", (int) _descending);
             return false;
         }
-        double power = (it->second - dval) / (it->first - time) * 3600.;
-        if (power > _maxPower) {
-            // consumption of energy must not be greater than limit
-            rlog.info("Plausi rejected: consumption of energy %.3f must not be greater than limit %.3f", power, _maxPower);
+        if (_overPower > 0) {
+            LOG_INFO("Plausi rejected: %d consumptions of energy must not be greater than limit %.3f", (int) _overPower, _maxPower);
             return false;
         }
-        time = it->first;
-        dval = it->second;
-        ++it;
     }
 
-    // values in queue are ok: use the center value as candidate, but test again with latest checked value
-    if (rlog.isDebugEnabled()) {
-        rlog.debug(queueAsString());
-    }
-    time_t candTime = _queue.at(_window/2).first;
-    double candValue = _queue.at(_window/2).second;
+    // values in queue are ok: use the candidate, but test again with latest checked value
+    LOG_DEBUG("Plausi window: %d values %.3f .. %.3f, candidate %.3f", (int) _queue.size(),
+              _queue.front().second, _queue.back().second, candValue);
     if (candValue < _value) {
-        rlog.info("Plausi rejected: value %.3f must be >= previous checked value %.3f", candValue, _value);
+        LOG_INFO("Plausi rejected: value %.3f must be >= previous checked value %.3f", candValue, _value);
         return false;
     }
-    double power = (candValue - _value) / (candTime - _time) * 3600.;
+    double power = this->power(std::make_pair(_time, _value), std::make_pair(candTime, candValue));
     if (power > _maxPower) {
-        rlog.info("Plausi rejected: consumption of energy (checked value) %.3f must not be greater than limit %.3f", power, _maxPower);
+        LOG_INFO("Plausi rejected: consumption of energy (checked value) %.3f must not be greater than limit %.3f", power, _maxPower);
         return false;
     }
 
     // everything is OK -> use the candidate value
     _time = candTime;
     _value = candValue;
-    if (rlog.isInfoEnabled()) {
-        rlog.info("Plausi accepted: %.3f of %s", _value, ctime(&_time));
-    }
+    saveState(false);
+    LOG_INFO("Plausi accepted: %.3f of %s", _value, _time.toString().c_str());
     return true;
 }
 
@@ -108,20 +363,6 @@ double Plausi::getCheckedValue() {
     return _value;
 }
 
-time_t Plausi::getCheckedTime() {
+Timestamp Plausi::getCheckedTime() {
     return _time;
 }
-
-std::string Plausi::queueAsString() {
-    std::string str;
-    char buf[20];
-    str += "[";
-    std::deque<std::pair<time_t, double> >::const_iterator it = _queue.begin();
-    for (; it != _queue.end(); ++it) {
-        sprintf(buf, "%.3f", it->second);
-        str += buf;
-        str += ", ";
-    }
-    str += "]";
-    return str;
-}
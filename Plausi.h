@@ -9,21 +9,46 @@
 #include <string>
 #include <deque>
 #include <utility>
-#include <ctime>
+
+#include "MeterProfile.h"
+#include "RollingMedian.h"
+#include "Timestamp.h"
 
 class Plausi {
 public:
-    Plausi(double maxPower = 5. /*m3*/, size_t window = 3);
-    bool check(const std::string & value, time_t time);
+    Plausi(double maxPower = 5. /*m3*/, size_t window = 3, bool median = false, bool reconcile = false,
+           const MeterLayout & layout = MeterLayout());
+    ~Plausi();
+    bool check(const std::string & value, const Timestamp & time);
+    void setStateFile(const std::string & stateFile, int maxAge);
     double getCheckedValue();
-    time_t getCheckedTime();
+    Timestamp getCheckedTime();
 private:
-    std::string queueAsString();
+    bool checkValue(const std::string & value, const Timestamp & time);
+    void loadState();
+    void saveState(bool force);
+    std::string reconcile(const std::string & value, const Timestamp & time) const;
+    double power(const std::pair<Timestamp, double> & from, const std::pair<Timestamp, double> & to) const;
+    bool isOutlier(const Timestamp & time, double value) const;
+    void push(const Timestamp & time, double value);
+    void pop();
     double _maxPower;
     size_t _window;
-    std::deque<std::pair<time_t, double> > _queue;
+    bool _median;
+    bool _reconcile;
+    MeterLayout _layout;
+    std::deque<std::pair<Timestamp, double> > _queue;
+    // number of neighbors in _queue with descending value resp. too high power
+    size_t _descending;
+    size_t _overPower;
+    size_t _outliers;
+    RollingMedian _rollingMedian;
     double _value;
-    time_t _time;
+    Timestamp _time;
+    std::string _stateFile;
+    // reading time of the last written state
+    Timestamp _stateSaved;
+    int _stateMaxAge;
 };
 
 #endif /* PLAUSI_H_ */
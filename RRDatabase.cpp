@@ -5,32 +5,124 @@
 
 #include <rrd.h>
 #include <iostream>
+#include <vector>
 
 #include <log4cpp/Category.hh>
 #include <log4cpp/Priority.hh>
 
 #include "RRDatabase.h"
+#include "Metrics.h"
 
-RRDatabase::RRDatabase(const char* filename) {
+/**
+ * Pending readings are written when there are rrdFlushCount of them or the oldest
+ * is rrdFlushInterval seconds old. With rrdDaemon the updates go to rrdcached.
+ */
+RRDatabase::RRDatabase(const char* filename, const Config & config) :
+    _daemon(config.getRrdDaemon()),
+    _flushCount(config.getRrdFlushCount() > 0 ? config.getRrdFlushCount() : 1),
+    _flushInterval(config.getRrdFlushInterval()),
+    _bulkCount(config.getRrdBulkCount() > 0 ? config.getRrdBulkCount() : 1),
+    _bulk(false) {
     _filename = new char[strlen(filename) + 1];
     strcpy(_filename, filename);
+    _pending.reserve(_flushCount);
 }
 
 RRDatabase::~RRDatabase() {
+    flush();
     delete[] _filename;
 }
 
-int RRDatabase::update(time_t time, double counter) {
+/**
+ * Bulk mode for reprocessing archives: large batches without time limit,
+ * readings older than the last update of the rrd file are skipped.
+ */
+void RRDatabase::setBulk(bool bulk) {
+    flush();
+    _bulk = bulk;
+    _pending.reserve(bulk ? _bulkCount : _flushCount);
+}
+
+/**
+ * rrdtool accepts fractional timestamps, the milliseconds of time are passed on.
+ */
+int RRDatabase::update(const Timestamp & time, double counter) {
     char values[256];
-    snprintf(values, 255, "%ld:%.1f:%.0f", (long)time, counter/*kWh*/, counter * 3600000. /*Ws*/);
+    snprintf(values, 255, "%ld.%03d:%.1f:%.0f", (long) time.time(), time.msec(), counter/*kWh*/, counter * 3600000. /*Ws*/);
 
-    char *updateparams[] = { "rrdupdate", _filename, values, NULL };
+    if (_pending.empty()) {
+        _pendingSince = Timestamp::now();
+    }
+    _pending.push_back(values);
+    if (_pending.size() >= (_bulk ? _bulkCount : _flushCount)) {
+        return flush();
+    }
+    return flushIfDue();
+}
+
+/**
+ * Flush if the oldest pending reading waits longer than rrdFlushInterval.
+ * Call regularly, e.g. once per frame.
+ */
+int RRDatabase::flushIfDue() {
+    if (_bulk || _pending.empty() || Timestamp::now() - _pendingSince < _flushInterval) {
+        return 0;
+    }
+    return flush();
+}
+
+/**
+ * Write all pending readings with one rrd_update call.
+ * rrdtool rejects the whole call for one bad value, e.g. a time not after the last update:
+ * then the readings are written one by one and only the rejected ones are dropped.
+ */
+int RRDatabase::flush() {
+    if (_pending.empty()) {
+        return 0;
+    }
+    StageTimer timer(STAGE_RRD);
+    int res = write(0, _pending.size());
+    if (res == 0) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::DEBUG << "RRD: wrote " << _pending.size() << " values";
+    } else if (_pending.size() > 1) {
+        size_t dropped = 0;
+        for (size_t i = 0; i < _pending.size(); ++i) {
+            if (write(i, 1) != 0) {
+                ++dropped;
+            }
+        }
+        log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "RRD: dropped " << dropped << " of "
+                                     << _pending.size() << " values";
+        res = dropped < _pending.size() ? 0 : res;
+    }
+    _pending.clear();
+
+    return res;
+}
+
+/**
+ * One rrd_update call for count pending readings from first.
+ */
+int RRDatabase::write(size_t first, size_t count) {
+    std::vector<char *> updateparams;
+    updateparams.push_back("rrdupdate");
+    if (!_daemon.empty()) {
+        updateparams.push_back("--daemon");
+        updateparams.push_back((char *) _daemon.c_str());
+    }
+    if (_bulk) {
+        updateparams.push_back("--skip-past-updates");
+    }
+    updateparams.push_back(_filename);
+    for (size_t i = first; i < first + count; ++i) {
+        updateparams.push_back((char *) _pending[i].c_str());
+    }
+    updateparams.push_back(NULL);
 
     rrd_clear_error();
-    int res = rrd_update(3, updateparams);
+    int res = rrd_update(updateparams.size() - 1, updateparams.data());
     if (res) {
         log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << rrd_get_error();
     }
-
     return res;
 }
@@ -1,21 +1,41 @@
 /*
  * RRDatabase.h
  *
+ * Readings are buffered and written with one rrd_update call per batch,
+ * since each update opens, locks and rewrites the rrd file.
+ *
  */
 
 #ifndef RRDATABASE_H_
 #define RRDATABASE_H_
 
 #include <string>
+#include <vector>
+
+#include "Config.h"
+#include "Timestamp.h"
 
 class RRDatabase {
 public:
-    RRDatabase(const char* filename);
+    RRDatabase(const char* filename, const Config & config);
     virtual ~RRDatabase();
-    int update(time_t time, double value);
+    int update(const Timestamp & time, double value);
+    int flushIfDue();
+    int flush();
+    void setBulk(bool bulk);
 
 private:
+    int write(size_t first, size_t count);
+
     char* _filename;
+    std::string _daemon;
+    size_t _flushCount;
+    int _flushInterval;
+    size_t _bulkCount;
+    bool _bulk;
+    std::vector<std::string> _pending;
+    // arrival of the oldest pending reading
+    Timestamp _pendingSince;
 };
 
 #endif /* RRDATABASE_H_ */
@@ -0,0 +1,71 @@
+/*
+ * RollingMedian.cpp
+ *
+ */
+
+#include <set>
+#include <utility>
+
+#include "RollingMedian.h"
+
+void RollingMedian::insert(double value, const Timestamp & time) {
+    Entry entry(value, time);
+    if (_low.empty() || !(*_low.rbegin() < entry)) {
+        _low.insert(entry);
+    } else {
+        _high.insert(entry);
+    }
+    rebalance();
+}
+
+/**
+ * Remove one occurrence of a previously inserted value and time.
+ */
+void RollingMedian::erase(double value, const Timestamp & time) {
+    Entry entry(value, time);
+    std::multiset<Entry>::iterator it;
+    if (!_low.empty() && !(*_low.rbegin() < entry)) {
+        it = _low.find(entry);
+        if (it != _low.end()) {
+            _low.erase(it);
+        }
+    } else {
+        it = _high.find(entry);
+        if (it != _high.end()) {
+            _high.erase(it);
+        }
+    }
+    rebalance();
+}
+
+void RollingMedian::clear() {
+    _low.clear();
+    _high.clear();
+}
+
+/**
+ * Lower median, so that the result is always one of the values.
+ */
+double RollingMedian::median() const {
+    return _low.empty() ? 0. : _low.rbegin()->first;
+}
+
+/**
+ * Time of the median, the middle one in time of equal values.
+ */
+Timestamp RollingMedian::medianTime() const {
+    return _low.empty() ? Timestamp() : _low.rbegin()->second;
+}
+
+void RollingMedian::rebalance() {
+    while (_low.size() > _high.size() + 1) {
+        std::multiset<Entry>::iterator it = --_low.end();
+        _high.insert(*it);
+        _low.erase(it);
+    }
+    while (_high.size() > _low.size()) {
+        std::multiset<Entry>::iterator it = _high.begin();
+        _low.insert(*it);
+        _high.erase(it);
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * RollingMedian.h
+ *
+ * Median of a sliding window of values with their times.
+ * Insert and erase are O(log n), the median and its time are O(1).
+ *
+ */
+
+#ifndef ROLLINGMEDIAN_H_
+#define ROLLINGMEDIAN_H_
+
+#include <set>
+#include <utility>
+#include <cstddef>
+
+#include "Timestamp.h"
+
+class RollingMedian {
+public:
+    void insert(double value, const Timestamp & time);
+    void erase(double value, const Timestamp & time);
+    void clear();
+    double median() const;
+    Timestamp medianTime() const;
+
+    size_t size() const {
+        return _low.size() + _high.size();
+    }
+
+private:
+    // ordered by value, equal values by time
+    typedef std::pair<double, Timestamp> Entry;
+
+    void rebalance();
+
+    // lower half including the median, _low.size() is _high.size() or _high.size() + 1
+    std::multiset<Entry> _low;
+    std::multiset<Entry> _high;
+};
+
+#endif /* ROLLINGMEDIAN_H_ */
@@ -0,0 +1,266 @@
+/*
+ * SeriesStore.cpp
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SeriesStore.h"
+
+#define SERIES_MAGIC "EMEOSER"
+#define SERIES_VERSION 1
+// records added to the file size at once
+#define SERIES_GROW 4096
+
+static const char * LEVEL_NAMES[SERIES_LEVELS] = { "hour", "day", "month" };
+
+SeriesFile::SeriesFile() :
+    _fd(-1), _writable(false), _recordSize(0), _data(0), _size(0) {
+}
+
+SeriesFile::~SeriesFile() {
+    close();
+}
+
+/**
+ * Open a series file, a writable file is created if it does not exist.
+ */
+bool SeriesFile::open(const std::string & path, uint32_t recordSize, bool writable) {
+    close();
+    _writable = writable;
+    _recordSize = recordSize;
+    _fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (_fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == -1) {
+        close();
+        return false;
+    }
+    if (st.st_size == 0 && writable) {
+        SeriesFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SERIES_MAGIC, sizeof(SERIES_MAGIC));
+        header.version = SERIES_VERSION;
+        header.recordSize = recordSize;
+        st.st_size = sizeof(header) + (off_t) SERIES_GROW * recordSize;
+        if (pwrite(_fd, &header, sizeof(header), 0) != sizeof(header) || ftruncate(_fd, st.st_size) == -1) {
+            close();
+            return false;
+        }
+    }
+    if ((size_t) st.st_size < sizeof(SeriesFileHeader) || !map(st.st_size)) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    const SeriesFileHeader * header = (const SeriesFileHeader *) _data;
+    if (memcmp(header->magic, SERIES_MAGIC, sizeof(SERIES_MAGIC)) != 0
+            || header->version != SERIES_VERSION || header->recordSize != recordSize) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+void SeriesFile::close() {
+    if (_data) {
+        munmap(_data, _size);
+        _data = 0;
+        _size = 0;
+    }
+    if (_fd != -1) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+bool SeriesFile::map(size_t size) {
+    if (_data) {
+        munmap(_data, _size);
+        _data = 0;
+    }
+    void * p = mmap(NULL, size, _writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, _fd, 0);
+    if (p == MAP_FAILED) {
+        _size = 0;
+        return false;
+    }
+    _data = (unsigned char *) p;
+    _size = size;
+    return true;
+}
+
+/**
+ * Number of valid records, a reader only sees the records of the file size at open.
+ */
+uint64_t SeriesFile::count() const {
+    if (!_data) {
+        return 0;
+    }
+    uint64_t count = __atomic_load_n(&((const SeriesFileHeader *) _data)->count, __ATOMIC_ACQUIRE);
+    uint64_t capacity = (_size - sizeof(SeriesFileHeader)) / _recordSize;
+    return count < capacity ? count : capacity;
+}
+
+const void * SeriesFile::record(uint64_t i) const {
+    return _data + sizeof(SeriesFileHeader) + i * _recordSize;
+}
+
+bool SeriesFile::append(const void * record) {
+    if (!_writable || !_data) {
+        return false;
+    }
+    uint64_t count = this->count();
+    if (sizeof(SeriesFileHeader) + (count + 1) * _recordSize > _size) {
+        size_t size = _size + (size_t) SERIES_GROW * _recordSize;
+        if (ftruncate(_fd, size) == -1 || !map(size)) {
+            return false;
+        }
+    }
+    memcpy(_data + sizeof(SeriesFileHeader) + count * _recordSize, record, _recordSize);
+    __atomic_store_n(&((SeriesFileHeader *) _data)->count, count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void SeriesFile::replaceLast(const void * record) {
+    uint64_t count = this->count();
+    if (_writable && count > 0) {
+        memcpy(_data + sizeof(SeriesFileHeader) + (count - 1) * _recordSize, record, _recordSize);
+    }
+}
+
+/**
+ * Index of the first record not older than time.
+ */
+uint64_t SeriesFile::lowerBound(int64_t time) const {
+    uint64_t lo = 0, hi = count();
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        int64_t t;
+        memcpy(&t, record(mid), sizeof(t));
+        if (t < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Open the series files in dir, as writer the directory and files are created.
+ */
+bool SeriesStore::open(const std::string & dir, bool writable) {
+    if (writable && mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        return false;
+    }
+    if (!_raw.open(dir + "/raw.ser", sizeof(SeriesReading), writable)) {
+        return false;
+    }
+    for (int level = 0; level < SERIES_LEVELS; ++level) {
+        if (!_aggregates[level].open(dir + "/" + LEVEL_NAMES[level] + ".ser", sizeof(SeriesAggregate), writable)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Append a reading and update the aggregates of its hour, day and month.
+ * Readings not newer than the last one are rejected.
+ */
+bool SeriesStore::append(const Timestamp & time, double value) {
+    SeriesReading reading = { time.micros(), value };
+    uint64_t count = _raw.count();
+    if (count > 0 && ((const SeriesReading *) _raw.record(count - 1))->time >= reading.time) {
+        return false;
+    }
+    if (!_raw.append(&reading)) {
+        return false;
+    }
+
+    for (int level = 0; level < SERIES_LEVELS; ++level) {
+        SeriesFile & file = _aggregates[level];
+        int64_t start = periodStart((SeriesLevel) level, reading.time);
+        count = file.count();
+        if (count > 0 && ((const SeriesAggregate *) file.record(count - 1))->time == start) {
+            SeriesAggregate aggregate = *(const SeriesAggregate *) file.record(count - 1);
+            aggregate.last = value;
+            aggregate.min = value < aggregate.min ? value : aggregate.min;
+            aggregate.max = value > aggregate.max ? value : aggregate.max;
+            ++aggregate.count;
+            file.replaceLast(&aggregate);
+        } else {
+            SeriesAggregate aggregate = { start, value, value, value, value, 1, 0 };
+            if (!file.append(&aggregate)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Readings with a time in [from, to], an unset to means no upper limit.
+ */
+size_t SeriesStore::query(const Timestamp & from, const Timestamp & to, std::vector<SeriesReading> & readings) const {
+    readings.clear();
+    uint64_t count = _raw.count();
+    for (uint64_t i = _raw.lowerBound(from.micros()); i < count; ++i) {
+        const SeriesReading * reading = (const SeriesReading *) _raw.record(i);
+        if (to.isSet() && reading->time > to.micros()) {
+            break;
+        }
+        readings.push_back(*reading);
+    }
+    return readings.size();
+}
+
+/**
+ * Aggregates of the periods that overlap [from, to], an unset to means no upper limit.
+ */
+size_t SeriesStore::query(SeriesLevel level, const Timestamp & from, const Timestamp & to,
+                          std::vector<SeriesAggregate> & aggregates) const {
+    aggregates.clear();
+    const SeriesFile & file = _aggregates[level];
+    uint64_t count = file.count();
+    for (uint64_t i = file.lowerBound(periodStart(level, from.micros())); i < count; ++i) {
+        const SeriesAggregate * aggregate = (const SeriesAggregate *) file.record(i);
+        if (to.isSet() && aggregate->time > to.micros()) {
+            break;
+        }
+        aggregates.push_back(*aggregate);
+    }
+    return aggregates.size();
+}
+
+/**
+ * Local start of the hour, day or month of time.
+ */
+int64_t SeriesStore::periodStart(SeriesLevel level, int64_t time) {
+    time_t sec = time / 1000000;
+    struct tm date;
+    localtime_r(&sec, &date);
+    if (level == SERIES_HOUR) {
+        // without mktime, which is ambiguous in the hour repeated at the end of DST
+        return (int64_t) (sec - date.tm_min * 60 - date.tm_sec) * 1000000;
+    }
+    date.tm_sec = 0;
+    date.tm_min = 0;
+    date.tm_hour = 0;
+    if (level == SERIES_MONTH) {
+        date.tm_mday = 1;
+    }
+    date.tm_isdst = -1;
+    return (int64_t) mktime(&date) * 1000000;
+}
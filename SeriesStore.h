@@ -0,0 +1,94 @@
+/*
+ * SeriesStore.h
+ *
+ * Append-only store of accepted readings at full resolution with hourly,
+ * daily and monthly aggregates. One memory mapped file per resolution:
+ *   <dir>/raw.ser, <dir>/hour.ser, <dir>/day.ser, <dir>/month.ser
+ *
+ * File layout:
+ *   SeriesFileHeader
+ *   record[capacity]    (the first count records are valid)
+ *
+ * Records are fixed size and ordered by time (microseconds since epoch),
+ * range queries use binary search. The count in the header is increased
+ * after the record is written, so a crash never exposes a partial record.
+ * The last aggregate of each file is the open period and updated in place.
+ */
+
+#ifndef SERIESSTORE_H_
+#define SERIESSTORE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Timestamp.h"
+
+struct SeriesFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+};
+
+struct SeriesReading {
+    int64_t time;
+    double value;
+};
+
+struct SeriesAggregate {
+    int64_t time; // local start of the period
+    double first;
+    double last;
+    double min;
+    double max;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+enum SeriesLevel {
+    SERIES_HOUR, SERIES_DAY, SERIES_MONTH, SERIES_LEVELS
+};
+
+/**
+ * Memory mapped file of fixed size records starting with an int64_t time.
+ */
+class SeriesFile {
+public:
+    SeriesFile();
+    ~SeriesFile();
+
+    bool open(const std::string & path, uint32_t recordSize, bool writable);
+    void close();
+    uint64_t count() const;
+    const void * record(uint64_t i) const;
+    bool append(const void * record);
+    void replaceLast(const void * record);
+    uint64_t lowerBound(int64_t time) const;
+
+private:
+    bool map(size_t size);
+
+    int _fd;
+    bool _writable;
+    uint32_t _recordSize;
+    unsigned char * _data;
+    size_t _size;
+};
+
+class SeriesStore {
+public:
+    bool open(const std::string & dir, bool writable = true);
+    bool append(const Timestamp & time, double value);
+    size_t query(const Timestamp & from, const Timestamp & to, std::vector<SeriesReading> & readings) const;
+    size_t query(SeriesLevel level, const Timestamp & from, const Timestamp & to,
+                 std::vector<SeriesAggregate> & aggregates) const;
+
+    static int64_t periodStart(SeriesLevel level, int64_t time);
+
+private:
+    SeriesFile _raw;
+    SeriesFile _aggregates[SERIES_LEVELS];
+};
+
+#endif /* SERIESSTORE_H_ */
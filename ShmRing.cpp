@@ -0,0 +1,168 @@
+/*
+ * ShmRing.cpp
+ *
+ */
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ShmRing.h"
+
+static int futex(uint32_t * uaddr, int op, uint32_t val, const struct timespec * timeout) {
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+ShmRing::ShmRing() :
+    _header(0), _mapSize(0), _owner(false) {
+}
+
+ShmRing::~ShmRing() {
+    close();
+}
+
+/**
+ * Create (or recreate) the shared memory segment as writer.
+ */
+bool ShmRing::create(const std::string & name, uint32_t slots, uint32_t slotSize) {
+    close();
+    _name = name;
+    int fd = shm_open(_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    slotSize = (slotSize + 63) & ~63u;
+    _mapSize = sizeof(ShmRingHeader) + (size_t) slots * slotSize;
+    if (ftruncate(fd, _mapSize) == -1) {
+        ::close(fd);
+        return false;
+    }
+    void * p = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    memset(p, 0, _mapSize);
+    _header = (ShmRingHeader *) p;
+    _header->slots = slots;
+    _header->slotSize = slotSize;
+    _header->version = SHMRING_VERSION;
+    __atomic_store_n(&_header->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+    _owner = true;
+    return true;
+}
+
+/**
+ * Attach to an existing segment as reader.
+ */
+bool ShmRing::open(const std::string & name) {
+    close();
+    _name = name;
+    int fd = shm_open(_name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(ShmRingHeader)) {
+        ::close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    _mapSize = st.st_size;
+    void * p = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    _header = (ShmRingHeader *) p;
+    if (__atomic_load_n(&_header->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC
+            || _header->version != SHMRING_VERSION
+            || sizeof(ShmRingHeader) + (size_t) _header->slots * _header->slotSize > _mapSize) {
+        close();
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+void ShmRing::close() {
+    if (_header) {
+        if (_owner) {
+            __atomic_store_n(&_header->closed, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&_header->frameCount, 1, __ATOMIC_RELEASE);
+            futex(&_header->frameCount, FUTEX_WAKE, INT_MAX, NULL);
+        }
+        munmap(_header, _mapSize);
+        _header = 0;
+    }
+    if (_owner) {
+        shm_unlink(_name.c_str());
+        _owner = false;
+    }
+}
+
+ShmFrameHeader * ShmRing::slot(uint64_t index) {
+    char * base = (char *) _header + sizeof(ShmRingHeader);
+    return (ShmFrameHeader *) (base + (size_t) (index % _header->slots) * _header->slotSize);
+}
+
+uint32_t ShmRing::maxDataSize(uint32_t slotSize) {
+    return slotSize - sizeof(ShmFrameHeader);
+}
+
+/**
+ * Publish one frame into the next slot and wake up waiting readers.
+ */
+bool ShmRing::write(uint32_t format, uint32_t width, uint32_t height, uint32_t stride,
+                    const void * data, uint32_t size, const struct timespec & time) {
+    if (!_header || size > maxDataSize(_header->slotSize)) {
+        errno = EINVAL;
+        return false;
+    }
+    uint64_t index = _header->writeIndex;
+    ShmFrameHeader * frame = slot(index);
+
+    uint64_t seq = frame->seq;
+    __atomic_store_n(&frame->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    frame->index = index;
+    frame->timeSec = time.tv_sec;
+    frame->timeNsec = time.tv_nsec;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->stride = stride;
+    frame->size = size;
+    memcpy(frame + 1, data, size);
+    __atomic_store_n(&frame->seq, seq + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&_header->writeIndex, index + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&_header->frameCount, 1, __ATOMIC_RELEASE);
+    futex(&_header->frameCount, FUTEX_WAKE, INT_MAX, NULL);
+    return true;
+}
+
+/**
+ * Wait until frameCount differs from lastFrameCount.
+ * Returns 1 on a new frame, 0 on timeout and -1 on error.
+ */
+int ShmRing::wait(uint32_t lastFrameCount, int timeoutMs) {
+    if (__atomic_load_n(&_header->frameCount, __ATOMIC_ACQUIRE) != lastFrameCount) {
+        return 1;
+    }
+    struct timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    if (futex(&_header->frameCount, FUTEX_WAIT, lastFrameCount, &ts) == -1
+            && errno != EAGAIN && errno != EINTR) {
+        return errno == ETIMEDOUT ? 0 : -1;
+    }
+    return __atomic_load_n(&_header->frameCount, __ATOMIC_ACQUIRE) != lastFrameCount ? 1 : 0;
+}
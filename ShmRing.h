@@ -0,0 +1,77 @@
+/*
+ * ShmRing.h
+ *
+ * Layout of the POSIX shared memory ring buffer used to pass raw frames
+ * from an external capture process to emeocv.
+ *
+ * The segment starts with a ShmRingHeader followed by 'slots' slots of
+ * 'slotSize' bytes. Each slot starts with a ShmFrameHeader and the raw
+ * pixel data. The writer publishes frames with a per slot sequence lock
+ * and increments the futex word 'frameCount' after each frame.
+ */
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stdint.h>
+#include <ctime>
+#include <string>
+
+#define SHMRING_MAGIC 0x454d4552 /* "EMER" */
+#define SHMRING_VERSION 1
+
+enum ShmFrameFormat {
+    SHM_FORMAT_GREY = 1, // 8 bit grey, stride >= width
+    SHM_FORMAT_YUYV = 2, // packed YUV 4:2:2, stride >= 2 * width
+    SHM_FORMAT_I420 = 3  // planar YUV 4:2:0, Y plane first, stride >= width
+};
+
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotSize;
+    uint32_t frameCount; // futex word, incremented after each published frame
+    uint32_t closed;     // set by the writer on shutdown
+    uint64_t writeIndex; // number of frames written so far
+};
+
+struct ShmFrameHeader {
+    uint64_t seq;        // odd while the slot is written
+    uint64_t index;      // frame index, matches writeIndex at time of writing
+    int64_t timeSec;     // wall clock capture time
+    int32_t timeNsec;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t size;       // number of valid data bytes
+};
+
+class ShmRing {
+public:
+    ShmRing();
+    ~ShmRing();
+
+    bool create(const std::string & name, uint32_t slots, uint32_t slotSize);
+    bool open(const std::string & name);
+    void close();
+
+    bool write(uint32_t format, uint32_t width, uint32_t height, uint32_t stride,
+               const void * data, uint32_t size, const struct timespec & time);
+    int wait(uint32_t lastFrameCount, int timeoutMs);
+
+    ShmRingHeader * header() {
+        return _header;
+    }
+    ShmFrameHeader * slot(uint64_t index);
+    static uint32_t maxDataSize(uint32_t slotSize);
+
+private:
+    std::string _name;
+    ShmRingHeader * _header;
+    size_t _mapSize;
+    bool _owner;
+};
+
+#endif /* SHMRING_H_ */
@@ -0,0 +1,514 @@
+/*
+ * Sink.cpp
+ *
+ */
+
+#include <string>
+#include <deque>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <math.h>
+#include <sys/stat.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Sink.h"
+#include "Metrics.h"
+
+// seconds to wait for the acknowledge of a QoS 1 message
+static const double MQTT_ACK_TIMEOUT = 30.;
+
+/**
+ * Bounded queue and thread in front of one sink.
+ */
+class SinkWorker {
+public:
+    SinkWorker(Sink * sink, size_t maxQueue, bool block);
+    ~SinkWorker();
+
+    void post(const Reading & reading);
+
+private:
+    void run();
+
+    Sink * _sink;
+    size_t _maxQueue;
+    bool _block;
+    std::deque<Reading> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    // signalled when a reading was taken from a full queue
+    std::condition_variable _space;
+    bool _exit;
+    unsigned long _dropped;
+    std::thread _thread;
+};
+
+SinkWorker::SinkWorker(Sink * sink, size_t maxQueue, bool block) :
+    _sink(sink), _maxQueue(maxQueue > 0 ? maxQueue : 1), _block(block), _exit(false), _dropped(0) {
+    _thread = std::thread(&SinkWorker::run, this);
+}
+
+/**
+ * Write all queued readings, then stop the thread and delete the sink.
+ */
+SinkWorker::~SinkWorker() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _exit = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+    delete _sink;
+}
+
+/**
+ * If the queue is full the reading is dropped, or with block the caller waits for space.
+ */
+void SinkWorker::post(const Reading & reading) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_block) {
+        _space.wait(lock, [this] { return _queue.size() < _maxQueue; });
+    }
+    if (_queue.size() >= _maxQueue) {
+        ++_dropped;
+        lock.unlock();
+        log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Sink " << _sink->name()
+                                     << " queue full, dropped reading (" << _dropped << " total)";
+        return;
+    }
+    _queue.push_back(reading);
+    lock.unlock();
+    _cond.notify_one();
+}
+
+void SinkWorker::run() {
+    Trace::setThreadName("sink " + _sink->name());
+    Timestamp lastTick = Timestamp::now();
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        if (_queue.empty()) {
+            if (_exit) {
+                break;
+            }
+            _cond.wait_for(lock, std::chrono::seconds(1));
+        } else {
+            Reading reading = _queue.front();
+            _queue.pop_front();
+            lock.unlock();
+            _space.notify_one();
+            {
+                TraceScope trace("sink", reading.frame);
+                _sink->write(reading);
+            }
+            lock.lock();
+        }
+        Timestamp now = Timestamp::now();
+        if (now - lastTick >= 1.) {
+            lastTick = now;
+            lock.unlock();
+            _sink->tick();
+            lock.lock();
+        }
+    }
+}
+
+Sink::~Sink() {
+}
+
+void Sink::tick() {
+}
+
+SinkFanout::SinkFanout(size_t queueSize, bool block) :
+    _queueSize(queueSize), _block(block) {
+}
+
+/**
+ * Deliver all pending readings and close the sinks.
+ */
+SinkFanout::~SinkFanout() {
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        delete _workers[i];
+    }
+}
+
+/**
+ * Add a sink, the fanout takes ownership.
+ */
+void SinkFanout::add(Sink * sink) {
+    log4cpp::Category::getRoot() << log4cpp::Priority::INFO << "Output to " << sink->name();
+    _workers.push_back(new SinkWorker(sink, _queueSize, _block));
+}
+
+void SinkFanout::publish(const Reading & reading) {
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i]->post(reading);
+    }
+}
+
+/**
+ * The comma separated list names has the sink.
+ */
+bool usesSink(const std::string & names, const std::string & sink) {
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name == sink) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The comma separated list names has a sink that needs the broker connection.
+ */
+bool usesMqtt(const std::string & names) {
+    return usesSink(names, "mqtt") || usesSink(names, "metrics");
+}
+
+/**
+ * Add the sinks of the comma separated list names: rrd, series, mqtt, metrics, file, stdout.
+ * MQTT values go to tele/<topic>/SENSOR, the broker connection with client id
+ * hostname is created by the first mqtt sink and shared by all others.
+ */
+void createSinks(SinkFanout & outputs, const std::string & names, const Config & config,
+                 const std::string & hostname, const std::string & topic,
+                 std::shared_ptr<MqttConnection> & connection, bool bulk) {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (name == "rrd") {
+            outputs.add(new RrdSink(config.getRrdFile().c_str(), config, bulk));
+        } else if (name == "series") {
+            if (config.getSeriesDir().empty()) {
+                rlog << log4cpp::Priority::ERROR << "Sink series requires seriesDir";
+            } else {
+                outputs.add(new SeriesSink(config.getSeriesDir()));
+            }
+        } else if (name == "mqtt") {
+            if (!connection) {
+                connection = std::make_shared<MqttConnection>(hostname, config);
+            }
+            outputs.add(new MqttSink(connection, topic, config));
+        } else if (name == "metrics") {
+            if (!connection) {
+                connection = std::make_shared<MqttConnection>(hostname, config);
+            }
+            outputs.add(new MetricsSink(connection, topic, config));
+        } else if (name == "file") {
+            outputs.add(new FileSink(config.getSinkFile()));
+        } else if (name == "stdout") {
+            outputs.add(new StdoutSink());
+        } else if (!name.empty()) {
+            rlog << log4cpp::Priority::ERROR << "Unknown sink " << name;
+        }
+    }
+}
+
+RrdSink::RrdSink(const char * filename, const Config & config, bool bulk) :
+    _rrd(filename, config) {
+    _rrd.setBulk(bulk);
+}
+
+std::string RrdSink::name() const {
+    return "rrd";
+}
+
+void RrdSink::write(const Reading & reading) {
+    if (reading.checked) {
+        _rrd.update(reading.checkedTime, reading.value);
+    }
+}
+
+void RrdSink::tick() {
+    _rrd.flushIfDue();
+}
+
+SeriesSink::SeriesSink(const std::string & dir) {
+    _open = _series.open(dir);
+    if (!_open) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't open series store " << dir;
+    }
+}
+
+std::string SeriesSink::name() const {
+    return "series";
+}
+
+void SeriesSink::write(const Reading & reading) {
+    if (_open && reading.checked) {
+        _series.append(reading.checkedTime, reading.value);
+    }
+}
+
+MqttSink::MqttSink(const std::shared_ptr<MqttConnection> & connection, const std::string & topic,
+                   const Config & config) :
+    _scale(MeterLayout(config.getMeterDigits(), config.getMeterDecimals()).scale()),
+    _deadband(llround(config.getMqttDeadband() * _scale)),
+    _minInterval(config.getMqttMinInterval()),
+    _heartbeat(config.getMqttHeartbeat()),
+    _batch(config.getMqttBatch() > 0 ? config.getMqttBatch() : 1),
+    _lastValue(-1.),
+    _replayRate(config.getMqttReplayRate() > 0 ? config.getMqttReplayRate() : 1),
+    _replayOffset(0),
+    _connection(connection),
+    _mosq(&connection->client()),
+    _topic(connection->client().make_topic(TOPIC_SENSOR, topic)) {
+    _pending.reserve(_batch);
+    if (!config.getMqttSpoolFile().empty()) {
+        _spool.open(config.getMqttSpoolFile(), config.getMqttSpoolMax());
+    }
+}
+
+MqttSink::~MqttSink() {
+    send();
+    // the connection closes after the last sink, a late acknowledge publishes twice
+    spoolUnacked(true);
+}
+
+std::string MqttSink::name() const {
+    return "mqtt " + _topic;
+}
+
+/**
+ * Decide by the time of the image, so that replayed images are published like live ones.
+ * A time before the last published one (clock step, new replay) publishes at once.
+ */
+void MqttSink::write(const Reading & reading) {
+    if (reading.value <= 0) {
+        return;
+    }
+    double elapsed = reading.time - _lastTime;
+    // in counts, 835.996 - 835.995 is less than 0.001 as double
+    bool changed = _lastValue < 0 || llabs(llround((reading.value - _lastValue) * _scale)) >= _deadband;
+    if (_lastTime.isSet() && elapsed >= 0. && !(changed && elapsed >= _minInterval) && elapsed < _heartbeat) {
+        return;
+    }
+    _lastValue = reading.value;
+    _lastTime = reading.time;
+    if (_pending.empty()) {
+        _pendingSince = Timestamp::now();
+    }
+    _pending.push_back(std::make_pair(reading.checkedTime, reading.value));
+    if (_pending.size() >= _batch) {
+        send();
+    }
+}
+
+/**
+ * An incomplete batch is sent after mqttHeartbeat seconds.
+ */
+void MqttSink::tick() {
+    if (!_pending.empty() && Timestamp::now() - _pendingSince >= _heartbeat) {
+        send();
+    }
+    spoolUnacked(false);
+    replay();
+    _spool.sync();
+}
+
+int MqttSink::publish(const std::vector<std::pair<Timestamp, double> > & values, int * mid) {
+    return values.size() == 1 ? _mosq->publish_state(_topic, values[0].second, values[0].first, mid)
+           : _mosq->publish_states(_topic, values, mid);
+}
+
+/**
+ * Check every message, acknowledges may come in any order.
+ */
+void MqttSink::markAcked(std::deque<InFlight> & messages) {
+    for (size_t i = 0; i < messages.size(); ++i) {
+        if (!messages[i].acked && _mosq->is_acked(messages[i].mid)) {
+            messages[i].acked = true;
+        }
+    }
+}
+
+/**
+ * Forget acknowledged live messages. The values of the others are spooled and
+ * published again when the connection is lost, after MQTT_ACK_TIMEOUT or with all.
+ */
+void MqttSink::spoolUnacked(bool all) {
+    markAcked(_live);
+    bool lost = all || !_mosq->is_connected();
+    Timestamp now = Timestamp::now();
+    while (!_live.empty()) {
+        const InFlight & message = _live.front();
+        if (!message.acked) {
+            if (!lost && now - message.sent < MQTT_ACK_TIMEOUT) {
+                break;
+            }
+            for (size_t i = 0; i < message.values.size(); ++i) {
+                _spool.append(message.values[i].first, message.values[i].second);
+            }
+        }
+        _live.pop_front();
+    }
+}
+
+/**
+ * Publish pending values, or spool them while disconnected or older values
+ * are still spooled, to keep the order.
+ */
+void MqttSink::send() {
+    if (_pending.empty()) {
+        return;
+    }
+    // unacknowledged values of a lost connection go to the spool first
+    spoolUnacked(false);
+    if (_spool.size() == 0 && _mosq->is_connected()) {
+        int mid;
+        int rc = publish(_pending, &mid);
+        if (rc == MOSQ_ERR_SUCCESS) {
+            InFlight message = { mid, Timestamp::now(), false, _pending, 0 };
+            _live.push_back(message);
+            _pending.clear();
+            return;
+        }
+        log4cpp::Category::getRoot() << log4cpp::Priority::WARN << "Can't publish: " << mosqpp::strerror(rc);
+    }
+    for (size_t i = 0; i < _pending.size(); ++i) {
+        _spool.append(_pending[i].first, _pending[i].second);
+    }
+    _pending.clear();
+}
+
+/**
+ * Publish spooled values while connected, mqttReplayRate messages per second.
+ * Values are removed from the spool when all messages up to theirs are
+ * acknowledged, a message without acknowledge within MQTT_ACK_TIMEOUT is
+ * published again. After a lost connection the replay starts over at the
+ * oldest spooled value.
+ */
+void MqttSink::replay() {
+    if (!_mosq->is_connected()) {
+        _replayed.clear();
+        _replayOffset = 0;
+        return;
+    }
+    markAcked(_replayed);
+    while (!_replayed.empty() && _replayed.front().acked) {
+        _spool.consume(_replayed.front().count);
+        _replayOffset -= std::min(_replayOffset, _replayed.front().count);
+        _replayed.pop_front();
+    }
+
+    Timestamp now = Timestamp::now();
+    size_t sent = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < _replayed.size() && sent < _replayRate; ++i) {
+        InFlight & message = _replayed[i];
+        if (!message.acked && now - message.sent >= MQTT_ACK_TIMEOUT
+                && _spool.peek(offset, message.count, _replayValues) > 0
+                && publish(_replayValues, &message.mid) == MOSQ_ERR_SUCCESS) {
+            message.sent = now;
+            ++sent;
+        }
+        offset += message.count;
+    }
+    size_t count = 0;
+    // at most MQTT_ACK_TIMEOUT seconds of messages waiting
+    while (sent < _replayRate && _replayed.size() < _replayRate * MQTT_ACK_TIMEOUT) {
+        if (_spool.peek(_replayOffset, _batch, _replayValues) == 0) {
+            break;
+        }
+        int mid;
+        if (publish(_replayValues, &mid) != MOSQ_ERR_SUCCESS) {
+            break;
+        }
+        InFlight message = { mid, now, false, std::vector<std::pair<Timestamp, double> >(), _replayValues.size() };
+        _replayed.push_back(message);
+        _replayOffset += _replayValues.size();
+        count += _replayValues.size();
+        ++sent;
+    }
+    if (count > 0) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::DEBUG << "Replayed " << count << " of "
+                                     << _spool.size() << " spooled values";
+    }
+}
+
+MetricsSink::MetricsSink(const std::shared_ptr<MqttConnection> & connection, const std::string & topic,
+                         const Config & config) :
+    _connection(connection),
+    _topic(connection->client().make_topic(TOPIC_METRICS, topic)),
+    _interval(config.getMetricsInterval() > 0 ? config.getMetricsInterval() : 60),
+    _lastSent(Timestamp::now()) {
+}
+
+std::string MetricsSink::name() const {
+    return "metrics " + _topic;
+}
+
+void MetricsSink::write(const Reading &) {
+}
+
+void MetricsSink::tick() {
+    Timestamp now = Timestamp::now();
+    if (now - _lastSent < _interval || !_connection->client().is_connected()) {
+        return;
+    }
+    _lastSent = now;
+    std::string payload = Metrics::get().json();
+    _connection->client().publish(NULL, _topic.c_str(), payload.length(), payload.c_str(), 0, false);
+}
+
+FileSink::FileSink(const std::string & filename) :
+    _filename(filename) {
+    _csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    struct stat st;
+    bool empty = stat(filename.c_str(), &st) != 0 || st.st_size == 0;
+    _file.open(filename.c_str(), std::ios::out | std::ios::app);
+    if (!_file) {
+        log4cpp::Category::getRoot() << log4cpp::Priority::ERROR << "Can't open " << filename << " :" << std::strerror(errno);
+    } else if (_csv && empty) {
+        _file << "time,ocr,checked,value\n";
+    }
+}
+
+std::string FileSink::name() const {
+    return "file " + _filename;
+}
+
+void FileSink::write(const Reading & reading) {
+    std::string time = reading.time.format("%Y-%m-%dT%H:%M:%S");
+    _file << std::fixed << std::setprecision(3);
+    if (_csv) {
+        _file << time << "," << reading.ocr << "," << reading.checked << "," << reading.value << "\n";
+    } else {
+        _file << "{\"time\":\"" << time << "\",\"ocr\":\"" << reading.ocr << "\",\"checked\":"
+              << (reading.checked ? "true" : "false") << ",\"value\":" << reading.value << "}\n";
+    }
+}
+
+/**
+ * Flush once a second instead of after every line.
+ */
+void FileSink::tick() {
+    _file.flush();
+}
+
+std::string StdoutSink::name() const {
+    return "stdout";
+}
+
+void StdoutSink::write(const Reading & reading) {
+    std::cout << (reading.checked ? "New  " : "Old  ") << std::left << std::setw(8) << reading.ocr << " "
+              << std::fixed << std::setprecision(3) << reading.value << std::endl;
+}
@@ -0,0 +1,210 @@
+/*
+ * Sink.h
+ *
+ * Outputs of the recognized meter readings. SinkFanout passes each reading
+ * to all sinks through a bounded queue and a worker thread per sink, so that
+ * a slow sink (network, SD card) never stalls image processing.
+ *
+ */
+
+#ifndef SINK_H_
+#define SINK_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <deque>
+
+#include "Config.h"
+#include "Timestamp.h"
+#include "RRDatabase.h"
+#include "SeriesStore.h"
+#include "Mqtt.h"
+#include "MqttSpool.h"
+#include "MeterProfile.h"
+
+/**
+ * Result of one image: the OCR result and the latest plausible value.
+ */
+struct Reading {
+    Timestamp time;
+    std::string ocr;
+    // value is a new checked value
+    bool checked;
+    // latest checked value, < 0 if there is none yet
+    double value;
+    Timestamp checkedTime;
+    // trace frame id
+    uint64_t frame;
+};
+
+class Sink {
+public:
+    virtual ~Sink();
+    virtual std::string name() const = 0;
+    virtual void write(const Reading & reading) = 0;
+    // called about once a second by the worker thread
+    virtual void tick();
+};
+
+class SinkWorker;
+
+class SinkFanout {
+public:
+    // block: wait for a full queue instead of dropping, for images of the past
+    SinkFanout(size_t queueSize, bool block = false);
+    ~SinkFanout();
+
+    void add(Sink * sink);
+    void publish(const Reading & reading);
+
+    size_t size() const {
+        return _workers.size();
+    }
+
+private:
+    size_t _queueSize;
+    bool _block;
+    std::vector<SinkWorker *> _workers;
+};
+
+bool usesSink(const std::string & names, const std::string & sink);
+bool usesMqtt(const std::string & names);
+void createSinks(SinkFanout & outputs, const std::string & names, const Config & config,
+                 const std::string & hostname, const std::string & topic,
+                 std::shared_ptr<MqttConnection> & connection, bool bulk);
+
+/**
+ * Checked values into the round robin database.
+ */
+class RrdSink: public Sink {
+public:
+    RrdSink(const char * filename, const Config & config, bool bulk);
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+    virtual void tick();
+
+private:
+    RRDatabase _rrd;
+};
+
+/**
+ * Checked values into the series store.
+ */
+class SeriesSink: public Sink {
+public:
+    SeriesSink(const std::string & dir);
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+
+private:
+    SeriesStore _series;
+    bool _open;
+};
+
+/**
+ * Latest checked value to the MQTT broker when it changed by more than
+ * mqttDeadband, at most every mqttMinInterval and at least every mqttHeartbeat
+ * seconds. With mqttBatch > 1 values are sent as JSON arrays.
+ * Values that can't be published are kept in the spool mqttSpoolFile and
+ * published after a reconnect with their original time.
+ * Values go to tele/<topic>/SENSOR, the connection may be shared by the
+ * sinks of several meters.
+ */
+class MqttSink: public Sink {
+public:
+    MqttSink(const std::shared_ptr<MqttConnection> & connection, const std::string & topic, const Config & config);
+    virtual ~MqttSink();
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+    virtual void tick();
+
+private:
+    /**
+     * Published message waiting for its acknowledge.
+     */
+    struct InFlight {
+        int mid;
+        Timestamp sent;
+        bool acked;
+        // live message: its values, spooled if it is not acknowledged
+        std::vector<std::pair<Timestamp, double> > values;
+        // replayed message: number of spooled values
+        size_t count;
+    };
+
+    int publish(const std::vector<std::pair<Timestamp, double> > & values, int * mid);
+    void markAcked(std::deque<InFlight> & messages);
+    void spoolUnacked(bool all);
+    void send();
+    void replay();
+
+    // values are compared as counts of the last digit
+    double _scale;
+    long long _deadband;
+    double _minInterval;
+    double _heartbeat;
+    size_t _batch;
+    double _lastValue;
+    Timestamp _lastTime;
+    std::vector<std::pair<Timestamp, double> > _pending;
+    // arrival of the oldest pending value
+    Timestamp _pendingSince;
+    MqttSpool _spool;
+    size_t _replayRate;
+    // in order of sending
+    std::deque<InFlight> _live;
+    std::deque<InFlight> _replayed;
+    // spooled values in _replayed
+    size_t _replayOffset;
+    std::vector<std::pair<Timestamp, double> > _replayValues;
+    std::shared_ptr<MqttConnection> _connection;
+    mosquittoPP * _mosq;
+    std::string _topic;
+};
+
+/**
+ * Processing metrics as JSON to tele/<topic>/METRICS every metricsInterval seconds.
+ */
+class MetricsSink: public Sink {
+public:
+    MetricsSink(const std::shared_ptr<MqttConnection> & connection, const std::string & topic, const Config & config);
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+    virtual void tick();
+
+private:
+    std::shared_ptr<MqttConnection> _connection;
+    std::string _topic;
+    double _interval;
+    Timestamp _lastSent;
+};
+
+/**
+ * All readings as CSV (file name ending with .csv) or JSON lines.
+ */
+class FileSink: public Sink {
+public:
+    FileSink(const std::string & filename);
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+    virtual void tick();
+
+private:
+    std::string _filename;
+    std::ofstream _file;
+    bool _csv;
+};
+
+/**
+ * All readings to the console.
+ */
+class StdoutSink: public Sink {
+public:
+    virtual std::string name() const;
+    virtual void write(const Reading & reading);
+};
+
+#endif /* SINK_H_ */
@@ -0,0 +1,65 @@
+/*
+ * ThreadPool.cpp
+ *
+ */
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t threads) :
+    _exit(false) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        _threads.push_back(std::thread(&ThreadPool::run, this));
+    }
+}
+
+/**
+ * Run the queued tasks, then stop the threads.
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _exit = true;
+    }
+    _cond.notify_all();
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        _threads[i].join();
+    }
+}
+
+/**
+ * Queue a task, the future is ready when it has run.
+ */
+std::future<void> ThreadPool::submit(const std::function<void()> & task) {
+    std::packaged_task<void()> packaged(task);
+    std::future<void> result = packaged.get_future();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(packaged));
+    }
+    _cond.notify_one();
+    return result;
+}
+
+void ThreadPool::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        if (_tasks.empty()) {
+            if (_exit) {
+                break;
+            }
+            _cond.wait(lock);
+        } else {
+            std::packaged_task<void()> task = std::move(_tasks.front());
+            _tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+}
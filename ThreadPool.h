@@ -0,0 +1,41 @@
+/*
+ * ThreadPool.h
+ *
+ * Fixed number of worker threads running queued tasks in order.
+ *
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+
+class ThreadPool {
+public:
+    // threads = 0: one per CPU core
+    ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    std::future<void> submit(const std::function<void()> & task);
+
+    size_t size() const {
+        return _threads.size();
+    }
+
+private:
+    void run();
+
+    std::deque<std::packaged_task<void()> > _tasks;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _exit;
+    std::vector<std::thread> _threads;
+};
+
+#endif /* THREADPOOL_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Timestamp.h
+ *
+ * Point in time with microsecond resolution.
+ * Holds the wall clock time and, if taken from the running system,
+ * the monotonic clock. Differences use the monotonic clock when both
+ * timestamps have one, so they are not affected by clock adjustments.
+ *
+ */
+
+#ifndef TIMESTAMP_H_
+#define TIMESTAMP_H_
+
+#include <stdint.h>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+class Timestamp {
+public:
+    Timestamp() :
+        _wall(0), _mono(0) {
+    }
+
+    static Timestamp now() {
+        struct timespec ts;
+        Timestamp t;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        t._wall = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        t._mono = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+        return t;
+    }
+
+    static Timestamp fromTime(time_t sec, long usec = 0) {
+        Timestamp t;
+        t._wall = sec * 1000000LL + usec;
+        return t;
+    }
+
+    static Timestamp fromMicros(int64_t usec) {
+        Timestamp t;
+        t._wall = usec;
+        return t;
+    }
+
+    static Timestamp fromSeconds(double seconds) {
+        Timestamp t;
+        t._wall = (int64_t) (seconds * 1e6 + (seconds < 0 ? -0.5 : 0.5));
+        return t;
+    }
+
+    /**
+     * Wall clock time in seconds since epoch.
+     */
+    time_t time() const {
+        return _wall / 1000000;
+    }
+
+    /**
+     * Wall clock time in microseconds since epoch.
+     */
+    int64_t micros() const {
+        return _wall;
+    }
+
+    long usec() const {
+        return _wall % 1000000;
+    }
+
+    int msec() const {
+        return usec() / 1000;
+    }
+
+    double seconds() const {
+        return _wall / 1e6;
+    }
+
+    bool isSet() const {
+        return _wall != 0;
+    }
+
+    /**
+     * Difference in seconds.
+     */
+    double operator-(const Timestamp & other) const {
+        if (_mono && other._mono) {
+            return (_mono - other._mono) / 1e6;
+        }
+        return (_wall - other._wall) / 1e6;
+    }
+
+    bool operator<(const Timestamp & other) const {
+        return _wall < other._wall;
+    }
+
+    bool operator<=(const Timestamp & other) const {
+        return _wall <= other._wall;
+    }
+
+    bool operator==(const Timestamp & other) const {
+        return _wall == other._wall;
+    }
+
+    bool operator!=(const Timestamp & other) const {
+        return _wall != other._wall;
+    }
+
+    /**
+     * Local time formatted by strftime format followed by the milliseconds.
+     */
+    std::string format(const char * fmt, const char * msecSeparator = ".") const {
+        char buf[64];
+        format(buf, sizeof(buf), fmt, msecSeparator);
+        return buf;
+    }
+
+    /**
+     * Same as format() into buf without allocation, returns the length.
+     */
+    size_t format(char * buf, size_t size, const char * fmt, const char * msecSeparator = ".") const {
+        struct tm date;
+        time_t sec = time();
+        localtime_r(&sec, &date);
+        size_t len = strftime(buf, size, fmt, &date);
+        int n = snprintf(buf + len, size - len, "%s%03d", msecSeparator, msec());
+        return n < 0 || len + n >= size ? strlen(buf) : len + n;
+    }
+
+    std::string toString() const {
+        return format("%Y-%m-%d %H:%M:%S");
+    }
+
+private:
+    int64_t _wall; // microseconds since epoch
+    int64_t _mono; // microseconds of CLOCK_MONOTONIC, 0 if unknown
+};
+
+#endif /* TIMESTAMP_H_ */
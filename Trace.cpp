@@ -0,0 +1,198 @@
+/*
+ * Trace.cpp
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Trace.h"
+
+/**
+ * Events of one thread. The lock is taken by the owning thread only,
+ * except while dumping.
+ */
+struct TraceBuffer {
+    int tid;
+    std::string name;
+    std::vector<TraceEvent> events;
+    size_t next;
+    bool wrapped;
+    std::mutex mutex;
+};
+
+std::atomic<bool> Trace::_enabled(false);
+volatile sig_atomic_t Trace::_dumpRequested = 0;
+
+static std::string tracePath;
+static size_t eventsPerThread = 0;
+static std::atomic<uint64_t> frameCount(0);
+static std::mutex buffersMutex;
+// buffers of finished threads are kept for the dump
+static std::vector<std::shared_ptr<TraceBuffer> > buffers;
+static thread_local TraceBuffer * threadBuffer = 0;
+static thread_local uint64_t threadFrame = 0;
+
+static TraceBuffer * buffer() {
+    if (!threadBuffer) {
+        std::shared_ptr<TraceBuffer> created = std::make_shared<TraceBuffer>();
+        created->events.resize(eventsPerThread);
+        created->next = 0;
+        created->wrapped = false;
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        created->tid = buffers.size() + 1;
+        buffers.push_back(created);
+        threadBuffer = created.get();
+    }
+    return threadBuffer;
+}
+
+/**
+ * Start recording, the most recent events of each thread are kept for dumps into path.
+ */
+void Trace::enable(const std::string & path, size_t events) {
+    tracePath = path;
+    eventsPerThread = events > 0 ? events : 1;
+    _enabled = true;
+}
+
+/**
+ * Assign the next frame id to the current thread, call before reading an image.
+ */
+uint64_t Trace::beginFrame() {
+    threadFrame = ++frameCount;
+    return threadFrame;
+}
+
+uint64_t Trace::currentFrame() {
+    return threadFrame;
+}
+
+/**
+ * Continue a frame in another thread, e.g. on the thread pool.
+ */
+void Trace::setFrame(uint64_t frame) {
+    threadFrame = frame;
+}
+
+void Trace::setThreadName(const std::string & name) {
+    if (enabled()) {
+        TraceBuffer * b = buffer();
+        std::lock_guard<std::mutex> lock(b->mutex);
+        b->name = name;
+    }
+}
+
+void Trace::record(const TraceEvent & event) {
+    TraceBuffer * b = buffer();
+    std::lock_guard<std::mutex> lock(b->mutex);
+    b->events[b->next] = event;
+    if (++b->next == b->events.size()) {
+        b->next = 0;
+        b->wrapped = true;
+    }
+}
+
+/**
+ * JSON string, names of meters and sinks come from the config.
+ */
+static void writeString(std::ostream & out, const char * s) {
+    out << '"';
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void writeEvent(std::ostream & out, const TraceEvent & event, int tid, bool & first) {
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    writeString(out, event.name);
+    out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << ",\"args\":{\"frame\":" << event.frame;
+    if (event.argName) {
+        out << ",";
+        writeString(out, event.argName);
+        out << ":" << event.argValue;
+    }
+    out << "}}";
+    first = false;
+}
+
+/**
+ * Write the events of all threads as Chrome trace JSON, oldest first.
+ * The file is replaced atomically.
+ */
+bool Trace::dump() {
+    log4cpp::Category & rlog = log4cpp::Category::getRoot();
+    if (!enabled()) {
+        return false;
+    }
+    const std::string & path = tracePath;
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath.c_str());
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    size_t count = 0;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        TraceBuffer & b = *buffers[i];
+        std::vector<TraceEvent> events;
+        std::string name;
+        {
+            std::lock_guard<std::mutex> bufferLock(b.mutex);
+            if (b.wrapped) {
+                events.insert(events.end(), b.events.begin() + b.next, b.events.end());
+            }
+            events.insert(events.end(), b.events.begin(), b.events.begin() + b.next);
+            name = b.name;
+        }
+        if (!name.empty()) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.tid
+                << ",\"args\":{\"name\":";
+            writeString(out, name.c_str());
+            out << "}}";
+            first = false;
+        }
+        for (size_t e = 0; e < events.size(); ++e) {
+            writeEvent(out, events[e], b.tid, first);
+        }
+        count += events.size();
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        rlog << log4cpp::Priority::ERROR << "Can't write trace " << path << " :" << std::strerror(errno);
+        return false;
+    }
+    rlog << log4cpp::Priority::INFO << "Wrote " << count << " trace events to " << path;
+    return true;
+}
+
+/**
+ * Dump after SIGUSR1, called between two frames.
+ */
+void Trace::dumpIfRequested() {
+    if (_dumpRequested) {
+        _dumpRequested = 0;
+        dump();
+    }
+}
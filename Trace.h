@@ -0,0 +1,109 @@
+/*
+ * Trace.h
+ *
+ * Opt-in tracing of the pipeline stages of single frames. Each thread
+ * records complete events (stage, begin, duration, frame id and one count)
+ * into a ring buffer of its own; dump() writes all buffers as Chrome trace
+ * JSON for chrome://tracing or ui.perfetto.dev, at exit or on SIGUSR1. While tracing is disabled
+ * a TraceScope costs one relaxed atomic load.
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+
+struct TraceEvent {
+    const char * name;
+    uint64_t begin;
+    uint64_t duration;
+    uint64_t frame;
+    // optional count, e.g. number of contours
+    const char * argName;
+    int64_t argValue;
+};
+
+class Trace {
+public:
+    static void enable(const std::string & path, size_t eventsPerThread);
+
+    static bool enabled() {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    // steady clock in microseconds
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t beginFrame();
+    static uint64_t currentFrame();
+    static void setFrame(uint64_t frame);
+    static void setThreadName(const std::string & name);
+    static void record(const TraceEvent & event);
+
+    static bool dump();
+    // async signal safe, for the SIGUSR1 handler
+    static void requestDump() {
+        _dumpRequested = 1;
+    }
+    static void dumpIfRequested();
+
+private:
+    static std::atomic<bool> _enabled;
+    static volatile sig_atomic_t _dumpRequested;
+};
+
+/**
+ * Records the scope as an event of the current frame.
+ */
+class TraceScope {
+public:
+    TraceScope(const char * name) :
+        _name(Trace::enabled() ? name : 0), _frame(0), _argName(0), _argValue(0) {
+        if (_name) {
+            _frame = Trace::currentFrame();
+            _begin = Trace::now();
+        }
+    }
+
+    TraceScope(const char * name, uint64_t frame) :
+        _name(Trace::enabled() ? name : 0), _frame(frame), _argName(0), _argValue(0) {
+        if (_name) {
+            _begin = Trace::now();
+        }
+    }
+
+    ~TraceScope() {
+        end();
+    }
+
+    // record the event before the end of the scope
+    void end() {
+        if (_name) {
+            TraceEvent event = { _name, _begin, Trace::now() - _begin, _frame, _argName, _argValue };
+            Trace::record(event);
+            _name = 0;
+        }
+    }
+
+    void arg(const char * name, int64_t value) {
+        _argName = name;
+        _argValue = value;
+    }
+
+private:
+    const char * _name;
+    uint64_t _frame;
+    uint64_t _begin;
+    const char * _argName;
+    int64_t _argValue;
+};
+
+#endif /* TRACE_H_ */
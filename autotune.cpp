@@ -0,0 +1,351 @@
+/*
+ * autotune.cpp
+ *
+ * Search the image processing and OCR parameters of a config on labelled
+ * images: candidates from a grid around the current values are scored on
+ * read accuracy and processing time, in parallel on all cores. Successive
+ * halving drops the worse half of the candidates after each round and
+ * doubles the images of the next round. The best candidate is written as
+ * config.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <set>
+#include <tuple>
+#include <random>
+#include <future>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+#include <unistd.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <log4cpp/Category.hh>
+#include <log4cpp/OstreamAppender.hh>
+#include <log4cpp/SimpleLayout.hh>
+#include <log4cpp/Priority.hh>
+
+#include "Config.h"
+#include "Directory.h"
+#include "FrameArchive.h"
+#include "ImageProcessor.h"
+#include "KNearestOcr.h"
+#include "Log.h"
+#include "ThreadPool.h"
+
+struct Sample {
+    std::string name;
+    cv::Mat image;
+    std::string digits;
+};
+
+struct Candidate {
+    Config config;
+    // results on the first evaluated samples
+    size_t evaluated;
+    size_t correctDigits;
+    size_t totalDigits;
+    size_t correctReadings;
+    double cpuSeconds;
+
+    double accuracy() const {
+        return totalDigits ? (double) correctDigits / totalDigits : 0.;
+    }
+
+    double millis() const {
+        return evaluated ? 1000. * cpuSeconds / evaluated : 0.;
+    }
+};
+
+// score: digit accuracy minus timeWeight per millisecond and image
+static double timeWeight = 0.001;
+
+static double score(const Candidate & candidate) {
+    return candidate.accuracy() - timeWeight * candidate.millis();
+}
+
+static bool better(const Candidate & a, const Candidate & b) {
+    return score(a) > score(b);
+}
+
+static void usage(const char * progname) {
+    std::cout << "Search image processing and OCR parameters on labelled images.\n";
+    std::cout << "Usage: " << progname << " -l <labels file> [-c <config>] [-o <config>] [-n <candidates>] [-j <threads>] [-w <weight>] [-v <level>]\n";
+    std::cout << "  -l <file> : labelled images, see below.\n";
+    std::cout << "  -c <file> : config to start from (default=config.yml).\n";
+    std::cout << "  -o <file> : write the best config into file (default=config of -c).\n";
+    std::cout << "  -n <n> : number of candidates (default=256).\n";
+    std::cout << "  -j <n> : number of threads (default=one per core).\n";
+    std::cout << "  -w <w> : loss of accuracy worth 1 ms per image (default=0.001).\n";
+    std::cout << "  -v <l> : Log level (default=ERROR).\n";
+    std::cout << "Labels file:\n";
+    std::cout << "  %YAML:1.0\n";
+    std::cout << "  samples:\n";
+    std::cout << "    - { image: \"images/20240101-120000.png\", digits: \"0012345\" }\n";
+    std::cout << "    - { archive: \"archive/20240101.fra\", time: \"20240101-130000\", digits: \"0012346\" }\n";
+}
+
+/**
+ * Images are read from png files or from frame archives, the first frame
+ * at or after time.
+ */
+static bool loadSamples(const std::string & path, std::vector<Sample> & samples) {
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cerr << "Can't read labels " << path << "\n";
+        return false;
+    }
+    cv::FileNode nodes = fs["samples"];
+    for (cv::FileNodeIterator it = nodes.begin(); it != nodes.end(); ++it) {
+        cv::FileNode node = *it;
+        Sample sample;
+        sample.digits = (std::string) node["digits"];
+        if (!node["image"].empty()) {
+            sample.name = (std::string) node["image"];
+            sample.image = cv::imread(sample.name);
+        } else {
+            std::string archive = (std::string) node["archive"];
+            std::string time = (std::string) node["time"];
+            sample.name = archive + "@" + time;
+            FrameArchiveReader reader;
+            Timestamp t;
+            if (reader.open(archive) && Directory::parseTime(time.c_str(), t)) {
+                size_t pos = reader.lowerBound(t.time());
+                if (pos < reader.count()) {
+                    reader.read(pos, sample.image);
+                }
+            }
+        }
+        if (sample.image.empty() || sample.digits.empty()) {
+            std::cerr << "Skip sample " << sample.name << ": no image or digits\n";
+            continue;
+        }
+        samples.push_back(sample);
+    }
+    return !samples.empty();
+}
+
+/**
+ * Grid around the values of config, random picks if it has more points than count.
+ */
+static std::vector<Candidate> createCandidates(const Config & config, size_t count) {
+    static const double factors[] = { 0.5, 0.75, 1., 1.5, 2. };
+    static const int heightSteps[] = { -10, -5, 0, 5, 10 };
+    static const int alignmentSteps[] = { -4, -2, 0, 2, 4 };
+    const size_t n = 5;
+
+    std::vector<Candidate> candidates;
+    Candidate base = { config, 0, 0, 0, 0, 0. };
+    // the current config takes part
+    candidates.push_back(base);
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+    std::set<std::tuple<int, int, int, int, int, int> > seen;
+    seen.insert(std::make_tuple(config.getCannyThreshold1(), config.getCannyThreshold2(), config.getDigitMinHeight(),
+                                config.getDigitMaxHeight(), config.getDigitYAlignment(),
+                                (int) std::lround(config.getOcrMaxDist())));
+    const size_t gridSize = n * n * n * n * n * n;
+    for (size_t tries = 0; candidates.size() < count && tries < 4 * gridSize; ++tries) {
+        int canny1 = (int) std::lround(config.getCannyThreshold1() * factors[pick(random)]);
+        int canny2 = (int) std::lround(config.getCannyThreshold2() * factors[pick(random)]);
+        int minHeight = config.getDigitMinHeight() + heightSteps[pick(random)];
+        int maxHeight = config.getDigitMaxHeight() + 2 * heightSteps[pick(random)];
+        int alignment = config.getDigitYAlignment() + alignmentSteps[pick(random)];
+        float maxDist = config.getOcrMaxDist() * factors[pick(random)];
+        if (canny1 < 1 || canny2 < 1 || minHeight < 1 || maxHeight <= minHeight || alignment < 1) {
+            continue;
+        }
+        if (!seen.insert(std::make_tuple(canny1, canny2, minHeight, maxHeight, alignment,
+                                         (int) std::lround(maxDist))).second) {
+            continue;
+        }
+        Candidate candidate = base;
+        candidate.config.setCannyThresholds(canny1, canny2);
+        candidate.config.setDigitHeights(minHeight, maxHeight);
+        candidate.config.setDigitYAlignment(alignment);
+        candidate.config.setOcrMaxDist(maxDist);
+        candidates.push_back(candidate);
+    }
+    return candidates;
+}
+
+static double threadCpuSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run the candidate on the samples it has not seen yet up to count.
+ */
+static void evaluate(Candidate & candidate, const std::vector<Sample> & samples, size_t count,
+                     const KNearestOcr & model) {
+    ImageProcessor proc(candidate.config);
+    KNearestOcr ocr(candidate.config);
+    ocr.shareModel(model);
+    for (; candidate.evaluated < count; ++candidate.evaluated) {
+        const Sample & sample = samples[candidate.evaluated];
+        // the processor replaces the image, not its pixels
+        cv::Mat img = sample.image;
+        double start = threadCpuSeconds();
+        proc.setInput(img);
+        proc.process();
+        std::string result = ocr.recognize(proc.getOutput());
+        candidate.cpuSeconds += threadCpuSeconds() - start;
+
+        for (size_t i = 0; i < sample.digits.size(); ++i) {
+            if (i < result.size() && result[i] == sample.digits[i]) {
+                ++candidate.correctDigits;
+            }
+        }
+        candidate.totalDigits += sample.digits.size();
+        if (result == sample.digits) {
+            ++candidate.correctReadings;
+        }
+    }
+}
+
+static void evaluateAll(std::vector<Candidate> & candidates, const std::vector<Sample> & samples, size_t count,
+                        const KNearestOcr & model, ThreadPool & pool) {
+    std::vector<std::future<void> > done;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        Candidate * candidate = &candidates[i];
+        done.push_back(pool.submit([candidate, &samples, count, &model]() {
+            evaluate(*candidate, samples, count, model);
+        }));
+    }
+    for (size_t i = 0; i < done.size(); ++i) {
+        done[i].get();
+    }
+}
+
+static void print(const Candidate & candidate, size_t samples) {
+    const Config & c = candidate.config;
+    std::cout << std::fixed << std::setprecision(3)
+              << "canny " << c.getCannyThreshold1() << "/" << c.getCannyThreshold2()
+              << " height " << c.getDigitMinHeight() << ".." << c.getDigitMaxHeight()
+              << " alignment " << c.getDigitYAlignment()
+              << " maxDist " << std::setprecision(0) << c.getOcrMaxDist() << std::setprecision(3)
+              << ": digits " << candidate.accuracy()
+              << ", readings " << candidate.correctReadings << "/" << samples
+              << ", " << candidate.millis() << " ms\n";
+}
+
+int main(int argc, char ** argv) {
+    int opt;
+    std::string labelsPath;
+    std::string configPath = "config.yml";
+    std::string outPath;
+    size_t count = 256;
+    size_t threads = 0;
+    std::string logLevel = "ERROR";
+
+    while ((opt = getopt(argc, argv, "l:c:o:n:j:w:v:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            labelsPath = optarg;
+            break;
+        case 'c':
+            configPath = optarg;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'w':
+            timeWeight = atof(optarg);
+            break;
+        case 'v':
+            logLevel = optarg;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (labelsPath.empty() || count < 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (outPath.empty()) {
+        outPath = configPath;
+    }
+
+    log4cpp::Category & root = log4cpp::Category::getRoot();
+    root.setPriority(log4cpp::Priority::getPriorityValue(logLevel));
+    log4cpp::Appender * appender = new log4cpp::OstreamAppender("console", &std::cerr);
+    appender->setLayout(new log4cpp::SimpleLayout());
+    root.addAppender(appender);
+    AsyncLog::start();
+
+    Config config;
+    if (!config.reloadConfig(configPath)) {
+        std::cerr << "Can't read config " << configPath << "\n";
+        exit(EXIT_FAILURE);
+    }
+    KNearestOcr model(config);
+    if (!model.loadTrainingData()) {
+        std::cerr << "Can't load OCR training data from " << config.getTrainingDataFilename() << "\n";
+        exit(EXIT_FAILURE);
+    }
+    std::vector<Sample> samples;
+    if (!loadSamples(labelsPath, samples)) {
+        exit(EXIT_FAILURE);
+    }
+    // the first images of each round are a random sample as well
+    std::shuffle(samples.begin(), samples.end(), std::mt19937(1));
+
+    // one candidate per thread, the processing time is the CPU time of that thread
+    cv::setNumThreads(1);
+    ThreadPool pool(threads);
+    std::vector<Candidate> candidates = createCandidates(config, count);
+    Candidate base = candidates.front();
+    std::cout << candidates.size() << " candidates, " << samples.size() << " images, "
+              << pool.size() << " threads\n";
+
+    size_t rounds = 0;
+    for (size_t c = candidates.size(); c > 1; c = (c + 1) / 2) {
+        ++rounds;
+    }
+    for (size_t round = 0;; ++round) {
+        // all images in the last round
+        size_t images = std::min(samples.size(), std::max((size_t) 8, samples.size() >> (rounds - round)));
+        evaluateAll(candidates, samples, images, model, pool);
+        std::stable_sort(candidates.begin(), candidates.end(), better);
+        std::cout << "Round " << round + 1 << ": " << candidates.size() << " candidates on " << images
+                  << " images, best ";
+        print(candidates.front(), images);
+        if (candidates.size() == 1) {
+            break;
+        }
+        candidates.resize((candidates.size() + 1) / 2);
+    }
+
+    const Candidate & best = candidates.front();
+    evaluate(base, samples, samples.size(), model);
+    std::cout << "Current: ";
+    print(base, samples.size());
+    std::cout << "Best:    ";
+    print(best, samples.size());
+    if (score(best) <= score(base)) {
+        std::cout << "The current config is not improved\n";
+        exit(EXIT_SUCCESS);
+    }
+    Config result = best.config;
+    result.saveConfig(outPath);
+    exit(EXIT_SUCCESS);
+}
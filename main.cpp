@@ -8,12 +8,14 @@
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <chrono>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <mosquittopp.h>
-#include <thread>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
@@ -26,12 +28,19 @@
 #include <log4cpp/SimpleLayout.hh>
 #include <log4cpp/Priority.hh>
 
+#include "CaptureScheduler.h"
 #include "Config.h"
+#include "ImageArchiver.h"
 #include "Directory.h"
 #include "ImageProcessor.h"
 #include "KNearestOcr.h"
 #include "Plausi.h"
-#include "RRDatabase.h"
+#include "Sink.h"
+#include "ConfigWatcher.h"
+#include "Meter.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 static int delay = 1000;
 
@@ -40,130 +49,49 @@ static int delay = 1000;
 #endif
 volatile bool do_exit = false;
 
-template<typename ... Args>
-std::string string_format( const std::string & format, Args ... args ) {
-    size_t size = snprintf( nullptr, 0, format.c_str(), args ... ) + 1;
-    if( size <= 0 ) {
-        throw std::runtime_error( "Error during formatting." );
-    }
-    std::unique_ptr<char[]> buf( new char[ size ] );
-    snprintf( buf.get(), size, format.c_str(), args ... );
-    return std::string( buf.get(), buf.get() + size - 1 );
-}
-
-Config config;
-
-#define ONLINE "Online"
-#define OFFLINE "Offline"
-
-const char * mqtt_host = "192.168.0.106";
-const int mqtt_port = 8883;
-const int mqtt_keepalive = 60;
-#define TOPIC_LWT "tele/%s/LWT"
-#define TOPIC_SENSOR "tele/%s/SENSOR"
-
-class mosquittoPP : public mosqpp::mosquittopp {
-public:
-    //using  mosqpp::mosquittopp::mosquittopp;
-    mosquittoPP(const char * id = NULL, bool clean_session = true, const char * hostname = "unknown");
-    void publish_lwt(bool online);
-    void publish_state(double gas_value);
-    void on_connect(int rc);
-    std::string make_topic(const std::string & tmpl);
-private:
-    std::string _hostname = "unknown";
-};
-
-mosquittoPP::mosquittoPP(const char * id, bool clean_session, const char * hostname):
-    mosqpp::mosquittopp(id, clean_session), _hostname(hostname) {
+/**
+ * Leave the processing loop on SIGINT/SIGTERM, so that buffered data is written.
+ */
+static void signalHandler(int) {
+    do_exit = true;
 }
 
-std::string mosquittoPP::make_topic(const std::string & tmpl) {
-    return string_format(tmpl, _hostname.c_str());
+/**
+ * Reload the config file on SIGHUP.
+ */
+static void reloadHandler(int) {
+    ConfigWatcher::requestReload();
 }
 
-void mosquittoPP::publish_lwt(bool online) {
-    const char * msg = online ? ONLINE : OFFLINE;
-    publish(NULL, make_topic(TOPIC_LWT).c_str(), strlen(msg), msg, 0, true);
+/**
+ * Write the trace on SIGUSR1.
+ */
+static void traceHandler(int) {
+    Trace::requestDump();
 }
 
-void mosquittoPP::publish_state(double gas_value) {
-
-    std::stringstream ss;
-    char tm_buffer[32] = {};
-    time_t now = time(NULL);
-    struct tm * tm_info = localtime(&now);
-    strftime(tm_buffer, 26, "%Y-%m-%dT%H:%M:%S", tm_info);
-
-    ss << "{\"Time\":\"" << tm_buffer << "\"," << "\"GAS\":" << std::fixed << std::setprecision(3) << gas_value << "}";
-    std::string msg = ss.str();
-    std::cout << ss.str() << std::endl;
-    publish(NULL, make_topic(TOPIC_SENSOR).c_str(), msg.length(), msg.c_str(), 0, false);
-}
+Config config;
+static ConfigWatcher * pConfigWatcher = 0;
 
-void mosquittoPP::on_connect(int rc) {
-    log4cpp::Category & rlog = log4cpp::Category::getRoot();
-    switch (rc) {
-    case 0:
-        rlog << log4cpp::Priority::INFO << "Connected to mqtt server.";
-        subscribe(NULL, "stat/+/POWER", 0);
-        publish_lwt(true);
-        break;
-    case 1:
-        rlog << log4cpp::Priority::ERROR << "Connection refused (unacceptable protocol version).";
-        break;
-    case 2:
-        rlog << log4cpp::Priority::ERROR << "Connection refused (identifier rejected).";
-        break;
-    case 3:
-        rlog << log4cpp::Priority::ERROR << "Connection refused (broker unavailable).";
-        break;
-    default:
-        rlog << log4cpp::Priority::ERROR << "Unknown connection error. (%s)" << mosqpp::strerror(rc);
-        break;
+/**
+ * Pass a reloaded config or training file to the pipeline, called between two images.
+ * The Plausi state is kept.
+ */
+static void updateConfig(unsigned & version, unsigned & trainingVersion, ImageProcessor & proc, KNearestOcr & ocr) {
+    if (pConfigWatcher && pConfigWatcher->version() != version) {
+        version = pConfigWatcher->version();
+        std::shared_ptr<const Config> snapshot = pConfigWatcher->get();
+        proc.setConfig(*snapshot);
+        ocr.setConfig(*snapshot);
     }
-    if (rc != 0) {
-        sleep(10);
+    if (pConfigWatcher && pConfigWatcher->trainingVersion() != trainingVersion) {
+        trainingVersion = pConfigWatcher->trainingVersion();
+        ocr.reloadTrainingData();
     }
+    ocr.swapModel();
+    Trace::dumpIfRequested();
 }
 
-static
-void mosq_thread_loop(mosquittoPP * mosq) {
-    log4cpp::Category & rlog = log4cpp::Category::getRoot();
-
-    while (!do_exit) {
-        int res = mosq->loop(1000, 1);
-        switch (res) {
-        case MOSQ_ERR_SUCCESS:
-            break;
-        case MOSQ_ERR_NO_CONN: {
-            int res = mosq->connect(mqtt_host, mqtt_port, mqtt_keepalive);
-            if (res) {
-                rlog << log4cpp::Priority::ERROR << "Can't connect to Mosquitto server %s" << mosqpp::strerror(res);
-                sleep(30);
-            }
-            break;
-        }
-        case MOSQ_ERR_INVAL:
-        case MOSQ_ERR_NOMEM:
-        case MOSQ_ERR_CONN_LOST:
-        case MOSQ_ERR_PROTOCOL:
-        case MOSQ_ERR_ERRNO:
-            rlog << log4cpp::Priority::ERROR <<  strerror(errno) << " " << mosqpp::strerror(res);
-            mosq->disconnect();
-            rlog << log4cpp::Priority::ERROR << "disconnected";
-            sleep(10);
-            rlog << log4cpp::Priority::ERROR << "Try to reconnect";
-            int res = mosq->connect(mqtt_host, mqtt_port, mqtt_keepalive);
-            if (res) {
-                rlog << log4cpp::Priority::ERROR << "Can't connect to Mosquitto server " << mosqpp::strerror(res);
-            } else {
-                rlog << log4cpp::Priority::ERROR << "Connected";
-            }
-            break;
-        }
-    }
-}
 
 static void testOcr(ImageInput * pImageInput) {
     log4cpp::Category::getRoot().info("testOcr");
@@ -172,7 +100,9 @@ static void testOcr(ImageInput * pImageInput) {
     proc.debugWindow();
     proc.debugDigits();
 
-    Plausi plausi(5, 3);
+    Plausi plausi(config.getPlausiMaxPower(), config.getPlausiWindow(), config.getPlausiMedian(),
+                  config.getPlausiReconcile(),
+                  MeterLayout(config.getMeterDigits(), config.getMeterDecimals()));
 
     KNearestOcr ocr(config);
     if (! ocr.loadTrainingData()) {
@@ -188,10 +118,7 @@ static void testOcr(ImageInput * pImageInput) {
         proc.process();
 
         std::string result = ocr.recognize(proc.getOutput());
-        time_t time = pImageInput->getTime();
-        char * str_time = std::ctime(&time);
-        str_time[strlen(str_time) - 1] = 0;
-        std::cout << str_time << "  ";
+        std::cout << pImageInput->getTime().toString() << "  ";
         std::cout << std::left << std::setw(8) << result;
         if (result.find("?") != std::string::npos) {
             std::cout << "Learn" << path << "  " << std::endl;
@@ -223,12 +150,15 @@ static void testOcr(ImageInput * pImageInput) {
     }
 }
 
-static void mqttOcr(ImageInput * pImageInput, mosquittoPP * mosq) {
+static void mqttOcr(ImageInput * pImageInput, SinkFanout & outputs) {
     log4cpp::Category::getRoot().info("mqttOcr");
 
     ImageProcessor proc(config);
 
-    Plausi plausi(5, 3);
+    Plausi plausi(config.getPlausiMaxPower(), config.getPlausiWindow(), config.getPlausiMedian(),
+                  config.getPlausiReconcile(),
+                  MeterLayout(config.getMeterDigits(), config.getMeterDecimals()));
+    plausi.setStateFile(config.getPlausiStateFile(), config.getPlausiStateMaxAge());
 
     KNearestOcr ocr(config);
     if (! ocr.loadTrainingData()) {
@@ -237,28 +167,32 @@ static void mqttOcr(ImageInput * pImageInput, mosquittoPP * mosq) {
     }
     std::cout << "OCR training data loaded from " << config.getTrainingDataFilename() << ".\n";
     std::string path;
+    unsigned configVersion = 0;
+    unsigned trainingVersion = 0;
 
     while (pImageInput->nextImage(path) && !do_exit) {
-        std::cout << "--------------=================------------" << std::endl;
+        LOG_DEBUG("--------------=================------------");
+        updateConfig(configVersion, trainingVersion, proc, ocr);
         proc.setInput(pImageInput->getImage());
+        if (!proc.checkQuality()) {
+            continue;
+        }
         proc.process();
 
         std::string result = ocr.recognize(proc.getOutput());
 
         if (result.find("?") != std::string::npos) {
-            std::cout << "Unrecognized  " << result << std::endl;
-            pImageInput->saveImage();
-        }
-        bool checked = plausi.check(result, pImageInput->getTime());
-        double value = plausi.getCheckedValue();
-        if (checked) {
-            std::cout << "New  " << std::left << std::setw(8) << result << " " << std::fixed << std::setprecision(3) << value << std::endl;
-        } else {
-            std::cout << "Old  " << std::left << std::setw(8) << result << " " << std::fixed << std::setprecision(3) << value << std::endl;
-        }
-        if (value > 0) {
-            mosq->publish_state(value);
+            LOG_INFO("Unrecognized  %s", result.c_str());
+            pImageInput->saveSnapshot();
         }
+        Reading reading;
+        reading.time = pImageInput->getTime();
+        reading.ocr = result;
+        reading.checked = plausi.check(result, reading.time);
+        reading.value = plausi.getCheckedValue();
+        reading.checkedTime = plausi.getCheckedTime();
+        reading.frame = Trace::currentFrame();
+        outputs.publish(reading);
     }
 }
 
@@ -351,16 +285,18 @@ static void capture(ImageInput * pImageInput) {
     }
 }
 
-static void writeData(ImageInput * pImageInput) {
+static void writeData(ImageInput * pImageInput, SinkFanout & outputs, bool replay) {
     log4cpp::Category::getRoot().info("writeData");
 
     ImageProcessor proc(config);
 
-    Plausi plausi(5, 3);
-
-    RRDatabase rrd("emeter.rrd");
+    Plausi plausi(config.getPlausiMaxPower(), config.getPlausiWindow(), config.getPlausiMedian(),
+                  config.getPlausiReconcile(),
+                  MeterLayout(config.getMeterDigits(), config.getMeterDecimals()));
+    plausi.setStateFile(config.getPlausiStateFile(), config.getPlausiStateMaxAge());
 
     struct stat st;
+    time_t imgdebugChecked = 0;
 
     KNearestOcr ocr(config);
     if (! ocr.loadTrainingData()) {
@@ -369,43 +305,79 @@ static void writeData(ImageInput * pImageInput) {
     }
     std::cout << "OCR training data loaded from " << config.getTrainingDataFilename() << ".\n";
 
+    // images of the past are read at the fixed delay, as are images of another program (-d):
+    // a longer delay would not slow the camera down, only queue up its images
+    bool fixed = replay || dynamic_cast<InotifyInput *>(pImageInput);
+    CaptureScheduler scheduler(delay, fixed ? 0 : config.getScheduleMaxDelay(), config.getScheduleCpuBudget(),
+                               MeterLayout(config.getMeterDigits(), config.getMeterDecimals()));
+
     std::cout << "<Ctrl-C> to quit.\n";
     std::string path;
-    while (pImageInput->nextImage(path)) {
+    unsigned configVersion = 0;
+    unsigned trainingVersion = 0;
+    // images in a row with digits found, but not meterDigits of them
+    int mismatched = 0;
+    while (!do_exit && pImageInput->nextImage(path)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        updateConfig(configVersion, trainingVersion, proc, ocr);
         proc.setInput(pImageInput->getImage());
-        proc.process();
+        if (proc.checkQuality()) {
+            proc.process();
+        }
 
-        if (proc.getOutput().size() == 7) {
-            std::string result = ocr.recognize(proc.getOutput());
-            if (plausi.check(result, pImageInput->getTime())) {
-                rrd.update(plausi.getCheckedTime(), plausi.getCheckedValue());
-            }
+        if (proc.getOutput().size() == (size_t) config.getMeterDigits()) {
+            Reading reading;
+            reading.time = pImageInput->getTime();
+            reading.ocr = ocr.recognize(proc.getOutput());
+            reading.checked = plausi.check(reading.ocr, reading.time);
+            reading.value = plausi.getCheckedValue();
+            reading.checkedTime = plausi.getCheckedTime();
+            reading.frame = Trace::currentFrame();
+            outputs.publish(reading);
+            scheduler.update(reading, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            mismatched = 0;
+        } else if (!proc.getOutput().empty() && ++mismatched == 100) {
+            log4cpp::Category::getRoot().warn("No reading written for 100 images: %d digits found, meterDigits is %d",
+                                              (int) proc.getOutput().size(), config.getMeterDigits());
         }
-        if (0 == stat("imgdebug", &st) && S_ISDIR(st.st_mode)) {
-            // write debug image
-            pImageInput->setOutputDir("imgdebug");
-            pImageInput->saveImage();
-            pImageInput->setOutputDir("");
+        time_t now = pImageInput->getTime().time();
+        if (now - imgdebugChecked >= 10 || now < imgdebugChecked) {
+            // look for the debug image directory from time to time only
+            imgdebugChecked = now;
+            bool imgdebug = 0 == stat("imgdebug", &st) && S_ISDIR(st.st_mode);
+            pImageInput->setSnapshotDir(imgdebug ? "imgdebug" : "");
         }
-        usleep(delay * 1000L);
+        // write debug image
+        pImageInput->saveSnapshot();
+        scheduler.sleep(do_exit);
     }
 }
 
 static void usage(const char * progname) {
     std::cout << "Program to read and recognize the counter of an electricity meter with OpenCV.\n";
     std::cout << "Version: " << VERSION << std::endl;
-    std::cout << "Usage: " << progname << " [-i <dir>|-c <cam>] [-l|-t|-a|-w|-o <dir>] [-s <delay>] [-v <level>\n";
+    std::cout << "Usage: " << progname << " [-i <dir>|-d <dir>|-c <cam>|-S <shm>|-I <archive>|-G <style>] [-l|-t|-a|-w|-o <dir>] [-s <delay>] [-v <level>\n";
+    std::cout << "       " << progname << " -M <meters file> [-s <delay>] [-v <level>]\n";
     std::cout << "\nImage input:\n";
     std::cout << "  -i <image directory> : read image files (png) from directory.\n";
     std::cout << "  -c <camera number> : read images from camera.\n";
+    std::cout << "  -S <shared memory name> : read raw frames from shared memory ring buffer (see shmfeed).\n";
+    std::cout << "  -I <archive file or directory> : read frames from packed frame archives.\n";
+    std::cout << "  -G <style file> : render synthetic counter images (see synthmeter).\n";
+    std::cout << "  -d <image directory> : wait for new image files (png) in directory.\n";
     std::cout << "\nOperation:\n";
     std::cout << "  -a : adjust camera.\n";
     std::cout << "  -o <directory> : capture images into directory.\n";
     std::cout << "  -l : learn OCR.\n";
     std::cout << "  -t : test OCR.\n";
     std::cout << "  -w : write OCR data to RR database. This is the normal working mode.\n";
+    std::cout << "  -M <meters file> : read several meters, each with its own input and config.\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -s <n> : Sleep n milliseconds after processing of each image (default=1000).\n";
+    std::cout << "  -X <directory> : save images into packed day archives instead of png files.\n";
+    std::cout << "  --from, -F <YYYYMMDD-HHMMSS> : start with images of this time (-i, -I).\n";
+    std::cout << "  --to, -T <YYYYMMDD-HHMMSS> : stop after images of this time (-i, -I).\n";
+    std::cout << "  -R : with -d also watch subdirectories.\n";
     std::cout << "  -v <l> : Log level. One of DEBUG, INFO, ERROR (default).\n";
 }
 
@@ -423,35 +395,86 @@ static void configureLogging(const std::string & priority = "INFO", bool toConso
         consoleAppender->setLayout(new log4cpp::SimpleLayout());
         root.addAppender(consoleAppender);
     }
+    AsyncLog::start();
 }
 
 int main(int argc, char ** argv) {
     int opt;
     ImageInput * pImageInput = 0;
-    mosquittoPP * mosq = 0;
+    SinkFanout * pOutputs = 0;
     int inputCount = 0;
     std::string outputDir;
+    std::string archiveDir;
+    InotifyInput * pInotifyInput = 0;
+    bool recursive = false;
+    bool replay = false;
+    time_t fromTime = 0;
+    time_t toTime = 0;
+    static struct option longOptions[] = {
+        { "from", required_argument, 0, 'F' },
+        { "to", required_argument, 0, 'T' },
+        { 0, 0, 0, 0 }
+    };
     std::string logLevel = "ERROR";
     std::string hostname = "gas_reco";
     std::string configpath = "config.yml";
-    std::thread * mosq_th = 0;
+    std::string metersFile;
     char cmd = 0;
     int cmdCount = 0;
 
-    while ((opt = getopt(argc, argv, "i:c:ltaws:ov:hd:mx:H:C:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:c:ltaws:ov:hd:mx:H:C:S:X:I:G:F:T:RM:", longOptions, 0)) != -1) {
         switch (opt) {
         case 'd':
-            pImageInput = new InotifyInput(optarg, 100000);
+            pImageInput = pInotifyInput = new InotifyInput(optarg, 100000);
             inputCount++;
             break;
+        case 'R':
+            recursive = true;
+            break;
         case 'i':
             pImageInput = new DirectoryInput(Directory(optarg, ".png"));
             inputCount++;
+            replay = true;
             break;
         case 'c':
             pImageInput = new CameraInput(atoi(optarg));
             inputCount++;
             break;
+        case 'S':
+            pImageInput = new ShmInput(optarg, 1000);
+            inputCount++;
+            break;
+        case 'I':
+            pImageInput = new ArchiveInput(optarg);
+            inputCount++;
+            replay = true;
+            break;
+        case 'G': {
+            MeterStyle style;
+            if (!style.load(optarg)) {
+                std::cout << "Can't read meter style " << optarg << "\n";
+                exit(EXIT_FAILURE);
+            }
+            pImageInput = new SyntheticInput(style, 0);
+            inputCount++;
+            replay = true;
+            break;
+        }
+        case 'F':
+        case 'T': {
+            // a typo must not mean no limit
+            Timestamp time;
+            if (!Directory::parseTime(optarg, time)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            if (opt == 'F') {
+                fromTime = time.time();
+            } else {
+                toTime = time.time();
+            }
+            break;
+        }
         case 'l':
         case 't':
         case 'a':
@@ -461,6 +484,13 @@ int main(int argc, char ** argv) {
             cmd = opt;
             cmdCount++;
             break;
+        case 'M':
+            // meters bring their own inputs
+            metersFile = optarg;
+            cmd = opt;
+            cmdCount++;
+            inputCount++;
+            break;
         case 's':
             delay = atoi(optarg);
             break;
@@ -470,6 +500,9 @@ int main(int argc, char ** argv) {
         case 'x':
             outputDir = optarg;
             break;
+        case 'X':
+            archiveDir = optarg;
+            break;
         case 'H':
             hostname = optarg;
             break;
@@ -498,26 +531,77 @@ int main(int argc, char ** argv) {
     }
 
     configureLogging(logLevel, true);
-    if (cmd == 'm') {
-        mosqpp::lib_init();
-        mosq = new mosquittoPP("gas_reco", true, hostname.c_str());
-        mosq->username_pw_set("owntracks", "zhopa");
-        mosq->will_set(mosq->make_topic(TOPIC_LWT).c_str(), strlen(OFFLINE), OFFLINE, 0, true);
-        mosq->connect(mqtt_host, mqtt_port, mqtt_keepalive);
-        mosq_th = new std::thread(mosq_thread_loop, mosq);
+    if (!config.getTraceFile().empty()) {
+        Trace::enable(config.getTraceFile(), config.getTraceEvents());
+        Trace::setThreadName("main");
+        signal(SIGUSR1, traceHandler);
+    }
+    MetricsServer * pMetricsServer = 0;
+    if ((cmd == 'w' || cmd == 'm' || cmd == 'M') && config.getMetricsPort() > 0) {
+        pMetricsServer = new MetricsServer(config.getMetricsAddress(), config.getMetricsPort());
+    }
+    if (cmd == 'M') {
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+        bool loaded;
+        {
+            // closed before exit: flushes the sinks and disconnects from the broker
+            MeterSet meters(config, hostname);
+            loaded = meters.load(metersFile, delay);
+            if (loaded) {
+                std::cout << "<Ctrl-C> to quit.\n";
+                meters.run(do_exit);
+            }
+        }
+        Trace::dump();
+        delete pMetricsServer;
+        exit(loaded ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    pImageInput->setArchiver(new ImageArchiver(config));
+    if (fromTime || toTime) {
+        pImageInput->setTimeRange(fromTime, toTime);
+    }
+    if (pInotifyInput) {
+        pInotifyInput->setRecursive(recursive);
+        pInotifyInput->setStateFile(config.getInotifyStateFile());
+    }
+    if (cmd == 'w' || cmd == 'm') {
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+        signal(SIGHUP, reloadHandler);
+        pConfigWatcher = new ConfigWatcher(configpath, config);
+    }
+    if (cmd == 'w' || cmd == 'm') {
+        std::string sinks = config.getSinks();
+        if (sinks.empty()) {
+            // outputs of the mode
+            if (cmd == 'm') {
+                sinks = "mqtt,stdout";
+            } else {
+                sinks = config.getSeriesDir().empty() ? "rrd" : "rrd,series";
+            }
+        }
+        // images of the past must not lose readings, live images must not lag
+        pOutputs = new SinkFanout(config.getSinkQueueSize(), replay);
+        std::shared_ptr<MqttConnection> connection;
+        createSinks(*pOutputs, sinks, config, hostname, hostname, connection, replay);
     }
 
     switch (cmd) {
     case 'o':
         pImageInput->setOutputDir(outputDir);
+        pImageInput->setOutputArchive(archiveDir);
         capture(pImageInput);
         break;
     case 'l':
         learnOcr(pImageInput);
         break;
     case 'm':
+        // -x saves every image, unrecognized ones also go to the snapshot directory
         pImageInput->setOutputDir(outputDir);
-        mqttOcr(pImageInput, mosq);
+        pImageInput->setSnapshotDir(config.getSnapshotDir());
+        pImageInput->setOutputArchive(archiveDir);
+        mqttOcr(pImageInput, *pOutputs);
         break;
     case 't':
         testOcr(pImageInput);
@@ -526,19 +610,17 @@ int main(int argc, char ** argv) {
         adjustCamera(pImageInput);
         break;
     case 'w':
-        writeData(pImageInput);
+        writeData(pImageInput, *pOutputs, replay);
         break;
     }
 
     do_exit = true;
     delete pImageInput;
-    if (cmd == 'm') {
-        mosq->publish_lwt(false);
-        mosq->disconnect();
-        mosq_th->join();
-        delete mosq;
-        delete mosq_th;
-        mosqpp::lib_cleanup();
-    }
+    // deliver pending readings
+    delete pOutputs;
+    delete pConfigWatcher;
+    // after the sinks, with their final writes
+    Trace::dump();
+    delete pMetricsServer;
     exit(EXIT_SUCCESS);
 }
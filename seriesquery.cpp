@@ -0,0 +1,96 @@
+/*
+ * seriesquery.cpp
+ *
+ * Print readings or aggregates of a series store written by emeocv -w
+ * as tab separated lines, e.g. for the scripts in www.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "Directory.h"
+#include "SeriesStore.h"
+
+static void usage(const char * progname) {
+    std::cout << "Print readings of a series store.\n";
+    std::cout << "Usage: " << progname << " -d <dir> [-l raw|hour|day|month] [-F <from>] [-T <to>]\n";
+    std::cout << "  -d <dir> : directory of the series store (seriesDir in config.yml).\n";
+    std::cout << "  -l <level> : raw readings (default) or aggregates per hour, day or month.\n";
+    std::cout << "  -F <YYYYMMDD-HHMMSS> : start with readings of this time.\n";
+    std::cout << "  -T <YYYYMMDD-HHMMSS> : stop after readings of this time.\n";
+    std::cout << "Raw lines are: time value\n";
+    std::cout << "Aggregate lines are: start first last min max count\n";
+}
+
+int main(int argc, char ** argv) {
+    int opt;
+    std::string dir;
+    std::string level = "raw";
+    Timestamp from;
+    Timestamp to;
+
+    while ((opt = getopt(argc, argv, "d:l:F:T:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 'l':
+            level = optarg;
+            break;
+        case 'F':
+            Directory::parseTime(optarg, from);
+            break;
+        case 'T':
+            Directory::parseTime(optarg, to);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (dir.empty()) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    SeriesStore store;
+    if (!store.open(dir, false)) {
+        std::cerr << "Can't open series store " << dir << ": " << strerror(errno) << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (level == "raw") {
+        std::vector<SeriesReading> readings;
+        store.query(from, to, readings);
+        for (size_t i = 0; i < readings.size(); ++i) {
+            printf("%.3f\t%.3f\n", readings[i].time / 1e6, readings[i].value);
+        }
+    } else {
+        SeriesLevel seriesLevel;
+        if (level == "hour") {
+            seriesLevel = SERIES_HOUR;
+        } else if (level == "day") {
+            seriesLevel = SERIES_DAY;
+        } else if (level == "month") {
+            seriesLevel = SERIES_MONTH;
+        } else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        std::vector<SeriesAggregate> aggregates;
+        store.query(seriesLevel, from, to, aggregates);
+        for (size_t i = 0; i < aggregates.size(); ++i) {
+            const SeriesAggregate & a = aggregates[i];
+            printf("%ld\t%.3f\t%.3f\t%.3f\t%.3f\t%u\n", (long) (a.time / 1000000), a.first, a.last, a.min, a.max, a.count);
+        }
+    }
+    exit(EXIT_SUCCESS);
+}
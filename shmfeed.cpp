@@ -0,0 +1,117 @@
+/*
+ * shmfeed.cpp
+ *
+ * Stand-in for an external capture daemon: reads png images from a
+ * directory and publishes them as raw grey frames into the shared
+ * memory ring buffer read by emeocv -S.
+ *
+ */
+
+#include <string>
+#include <list>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "Directory.h"
+#include "ShmRing.h"
+
+static volatile bool do_exit = false;
+
+static void onSignal(int) {
+    do_exit = true;
+}
+
+static void usage(const char * progname) {
+    std::cout << "Publish png images as raw grey frames into a shared memory ring buffer.\n";
+    std::cout << "Usage: " << progname << " -n <name> -i <dir> [-s <delay>] [-r <slots>] [-l]\n";
+    std::cout << "  -n <name> : name of the shared memory segment, e.g. /emeocv.\n";
+    std::cout << "  -i <image directory> : read image files (png) from directory.\n";
+    std::cout << "  -s <n> : Sleep n milliseconds after each frame (default=1000).\n";
+    std::cout << "  -r <n> : Number of ring buffer slots (default=8).\n";
+    std::cout << "  -l : Loop over the images until interrupted.\n";
+}
+
+int main(int argc, char ** argv) {
+    int opt;
+    std::string name;
+    std::string inputDir;
+    int delay = 1000;
+    int slots = 8;
+    bool loop = false;
+
+    while ((opt = getopt(argc, argv, "n:i:s:r:lh")) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'i':
+            inputDir = optarg;
+            break;
+        case 's':
+            delay = atoi(optarg);
+            break;
+        case 'r':
+            slots = atoi(optarg);
+            break;
+        case 'l':
+            loop = true;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (name.empty() || inputDir.empty() || slots < 2) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    Directory directory(inputDir.c_str(), ".png");
+    std::list<std::string> files = directory.list();
+    files.sort();
+    if (files.empty()) {
+        std::cerr << "No png images in " << inputDir << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // size the slots after the first image
+    cv::Mat first = cv::imread(directory.fullpath(files.front()), cv::IMREAD_GRAYSCALE);
+    if (first.empty()) {
+        std::cerr << "Can't read " << files.front() << "\n";
+        exit(EXIT_FAILURE);
+    }
+    ShmRing ring;
+    if (!ring.create(name, slots, sizeof(ShmFrameHeader) + 2 * first.total())) {
+        std::cerr << "Can't create shared memory " << name << ": " << strerror(errno) << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    do {
+        for (std::list<std::string>::const_iterator it = files.begin(); it != files.end() && !do_exit; ++it) {
+            cv::Mat img = cv::imread(directory.fullpath(*it), cv::IMREAD_GRAYSCALE);
+            if (img.empty() || !img.isContinuous()) {
+                continue;
+            }
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            if (!ring.write(SHM_FORMAT_GREY, img.cols, img.rows, img.cols, img.data, img.total(), now)) {
+                std::cerr << "Skip " << *it << ": " << strerror(errno) << "\n";
+                continue;
+            }
+            usleep(delay * 1000L);
+        }
+    } while (loop && !do_exit);
+
+    ring.close();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,136 @@
+/*
+ * synthmeter.cpp
+ *
+ * Render synthetic counter images with known digits into a directory, as
+ * png files named by their time like the captured images. The digits of
+ * each image are appended to a labels file for autotune, so the images
+ * serve as load test for -i/-d and as accuracy regression.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "Directory.h"
+#include "MeterRenderer.h"
+
+static volatile bool do_exit = false;
+
+static void onSignal(int) {
+    do_exit = true;
+}
+
+/**
+ * imwrite picks the encoder by the extension, so encode explicitly for a file name without .png.
+ */
+static bool writePng(const std::string & path, const cv::Mat & img) {
+    std::vector<uchar> buf;
+    if (!cv::imencode(".png", img, buf)) {
+        return false;
+    }
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+    out.close();
+    return !out.fail();
+}
+
+static void usage(const char * progname) {
+    std::cout << "Render synthetic counter images with known digits.\n";
+    std::cout << "Usage: " << progname << " -o <dir> [-y <style>] [-n <count>] [-F <time>] [-s <delay>] [-l <labels>]\n";
+    std::cout << "  -o <dir> : write png images into directory.\n";
+    std::cout << "  -y <file> : style of the counter and the camera, see README.\n";
+    std::cout << "  -n <n> : number of images, 0 until interrupted (default=100).\n";
+    std::cout << "  -F <YYYYMMDD-HHMMSS> : time of the first image (default=now).\n";
+    std::cout << "  -s <n> : Sleep n milliseconds after each image, e.g. to feed emeocv -d (default=0).\n";
+    std::cout << "  -l <file> : labels for autotune (default=<dir>/labels.yml).\n";
+}
+
+int main(int argc, char ** argv) {
+    int opt;
+    std::string outputDir;
+    std::string stylePath;
+    std::string labelsPath;
+    long count = 100;
+    int delay = 0;
+    Timestamp start = Timestamp::now();
+
+    while ((opt = getopt(argc, argv, "o:y:n:F:s:l:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            outputDir = optarg;
+            break;
+        case 'y':
+            stylePath = optarg;
+            break;
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'F':
+            if (!Directory::parseTime(optarg, start)) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            delay = atoi(optarg);
+            break;
+        case 'l':
+            labelsPath = optarg;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (outputDir.empty() || count < 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    MeterStyle style;
+    if (!stylePath.empty() && !style.load(stylePath)) {
+        std::cerr << "Can't read style " << stylePath << "\n";
+        exit(EXIT_FAILURE);
+    }
+    if (labelsPath.empty()) {
+        labelsPath = outputDir + "/labels.yml";
+    }
+    std::ofstream labels(labelsPath.c_str());
+    if (!labels) {
+        std::cerr << "Can't write " << labelsPath << "\n";
+        exit(EXIT_FAILURE);
+    }
+    labels << "%YAML:1.0\nsamples:\n";
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    MeterRenderer renderer(style, start);
+    cv::Mat img;
+    for (long i = 0; (count == 0 || i < count) && !do_exit; ++i) {
+        renderer.next(img);
+        std::string name = renderer.time().format("%Y%m%d-%H%M%S", "-") + ".png";
+        std::string path = outputDir + "/" + name;
+        // appear complete for inotify, the temporary dot file is no image of the directory
+        std::string tmpPath = outputDir + "/." + name + ".tmp";
+        if (!writePng(tmpPath, img) || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::cerr << "Can't write " << path << "\n";
+            exit(EXIT_FAILURE);
+        }
+        labels << "  - { image: \"" << path << "\", digits: \"" << renderer.digits() << "\" }\n";
+        labels.flush();
+        if (delay > 0) {
+            usleep(delay * 1000L);
+        }
+    }
+    exit(EXIT_SUCCESS);
+}